@@ -36,6 +36,14 @@ inline std::shared_ptr<TextVariable> makeTextVar(const Docx &d, const QString &k
 QTDOCTXTEMPLATE_EXPORT std::shared_ptr<ImageVariable> makeImageVar(const QString &keyOrName, const QImage &img, int wPx, int hPx, const VariablePattern &pat = {});
 inline std::shared_ptr<ImageVariable> makeImageVar(const Docx &d, const QString &keyOrName, const QImage &img, int wPx, int hPx){ return makeImageVar(keyOrName, img, wPx, hPx, d.variablePattern()); }
 
+/** Create an ImageVariable from encoded PNG/JPEG/GIF bytes, embedded as-is (format detected if empty). */
+QTDOCTXTEMPLATE_EXPORT std::shared_ptr<ImageVariable> makeEncodedImageVar(const QString &keyOrName, const QByteArray &encoded, const QString &format, int wPx, int hPx, const VariablePattern &pat = {});
+inline std::shared_ptr<ImageVariable> makeEncodedImageVar(const Docx &d, const QString &keyOrName, const QByteArray &encoded, const QString &format, int wPx, int hPx){ return makeEncodedImageVar(keyOrName, encoded, format, wPx, hPx, d.variablePattern()); }
+
+/** Create a file-backed ImageVariable, streamed from disk on save (size read from the file header if 0). */
+QTDOCTXTEMPLATE_EXPORT std::shared_ptr<ImageVariable> makeImageFileVar(const QString &keyOrName, const QString &filePath, int wPx = 0, int hPx = 0, const VariablePattern &pat = {});
+inline std::shared_ptr<ImageVariable> makeImageFileVar(const Docx &d, const QString &keyOrName, const QString &filePath, int wPx = 0, int hPx = 0){ return makeImageFileVar(keyOrName, filePath, wPx, hPx, d.variablePattern()); }
+
 /** Create a BulletListVariable from item texts (key wrapped if necessary). */
 QTDOCTXTEMPLATE_EXPORT std::shared_ptr<BulletListVariable> makeBulletListVar(const QString &keyOrName, const QStringList &items, const VariablePattern &pat = {});
 inline std::shared_ptr<BulletListVariable> makeBulletListVar(const Docx &d, const QString &keyOrName, const QStringList &items){ return makeBulletListVar(keyOrName, items, d.variablePattern()); }
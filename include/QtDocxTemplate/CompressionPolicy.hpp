@@ -0,0 +1,52 @@
+/** \file CompressionPolicy.hpp
+ *  Per-part ZIP compression settings applied to parts written on save.
+ *  Parts copied unchanged from the template keep their original compressed bytes.
+ */
+#pragma once
+#include "QtDocxTemplate/Export.hpp"
+#include <QString>
+#include <QRegularExpression>
+#include <vector>
+
+namespace QtDocxTemplate {
+
+/** Ordered list of rules mapping part name or content type to a store/deflate choice and level.
+ *  Later rules take precedence, so defaults() can be refined by adding rules; if none matches the fallback applies.
+ */
+class QTDOCTXTEMPLATE_EXPORT CompressionPolicy {
+public:
+    enum class Method { Store, Deflate };
+    /** Compression choice for one part. level follows zlib (1 fastest .. 9 smallest; 0..maxLevel(), larger values
+     *  are clamped when a rule is added); ignored for Store.
+     */
+    struct Setting {
+        Method method{Method::Deflate};
+        int level{6};
+    };
+
+    /** Highest accepted level: 9 with zlib, 12 when built with libdeflate (QDT_USE_LIBDEFLATE). */
+    static int maxLevel();
+
+    /** Store already-compressed media (PNG/JPEG/GIF, audio, video), deflate XML at level 1, anything else at level 6. */
+    static CompressionPolicy defaults();
+
+    /** Rule for part names matching a wildcard ('*' any sequence, '?' one character), e.g. "word/media/*". */
+    CompressionPolicy & addPartRule(const QString &partPattern, Setting setting);
+    /** Rule for content types matching a wildcard, e.g. "image/png" or "*+xml". */
+    CompressionPolicy & addContentTypeRule(const QString &contentTypePattern, Setting setting);
+    /** Setting used when no rule matches. */
+    void setFallback(Setting setting);
+    /** Resolve the setting for a part (name without leading '/'; contentType may be empty). */
+    Setting settingFor(const QString &partName, const QString &contentType) const;
+
+private:
+    struct Rule {
+        bool byContentType{false};
+        QRegularExpression re;
+        Setting setting;
+    };
+    std::vector<Rule> m_rules;
+    Setting m_fallback;
+};
+
+} // namespace QtDocxTemplate
@@ -6,11 +6,16 @@
 #include "QtDocxTemplate/Export.hpp"
 #include "QtDocxTemplate/VariablePattern.hpp"
 #include "QtDocxTemplate/Variables.hpp"
+#include "QtDocxTemplate/CompressionPolicy.hpp"
 #include <QString>
 #include <QStringList>
+#include <QByteArray>
+#include <QHash>
 #include <memory>
 #include <optional>
 
+class QIODevice;
+
 namespace QtDocxTemplate {
 
 // Forward declarations & internal includes
@@ -18,7 +23,8 @@ namespace opc { class Package; }
 namespace xml { class XmlPart; }
 
 /** Main API entry. Load a template, configure pattern, replace variables, and save.
- *  Thread-safety: instances are not thread-safe. One instance per document.
+ *  Thread-safety: instances are not thread-safe. One instance per document; fork() a preloaded
+ *  template instance to obtain per-document instances (fork() itself may be called concurrently).
  */
 class QTDOCTXTEMPLATE_EXPORT Docx {
 public:
@@ -27,16 +33,44 @@ public:
         OpenFailed,
         DocumentPartMissing,
         XmlParseFailed,
-        TableColumnLengthMismatch
+        TableColumnLengthMismatch,
+        SaveFailed
     };
     /** Construct with path to an existing .docx template. No I/O until first operation. */
     explicit Docx(QString templatePath);
+    /** Construct from a .docx held by device. The template bytes are read immediately (device opened ReadOnly if needed);
+     *  parsing is still deferred to the first operation. */
+    explicit Docx(QIODevice *device);
+    /** Construct from an in-memory .docx (buffer is shared, not copied). No parsing until first operation. */
+    static Docx fromData(const QByteArray &templateData);
     ~Docx();
 
+    /** Open the template and inflate all XML parts now. Returns false and sets OpenFailed on error. */
+    bool preload() const;
+    /** Independent instance over the same template state (pattern, compression policy, current parts).
+     *  The archive is not re-read: part buffers and parsed XML parts are shared copy-on-write, and a part is
+     *  copied only when a fill first replaces something in it. Call preload() first so forks do not inflate
+     *  parts individually. Safe to call concurrently on an instance that is not being modified.
+     */
+    Docx fork() const;
+
     /** Override variable pattern (default ${ .. }). */
     void setVariablePattern(const VariablePattern &pattern);
     /** Current variable pattern in effect. */
     const VariablePattern & variablePattern() const { return m_pattern; }
+    /** Override how rewritten parts are compressed on save (default CompressionPolicy::defaults()). */
+    void setCompressionPolicy(const CompressionPolicy &policy);
+    /** Compression policy in effect. */
+    const CompressionPolicy & compressionPolicy() const { return m_compressionPolicy; }
+    /** Opt-in downscaling of QImage variables before encoding: images larger than their placed size times factor
+     *  are resampled (smooth filter) to that size, e.g. 2.0 keeps enough pixels for 192 DPI output.
+     *  0 (default) embeds images at full resolution. Encoded/file images are never resampled. */
+    void setImageDownscaleFactor(double factor) { m_imageDownscaleFactor = factor; }
+    double imageDownscaleFactor() const { return m_imageDownscaleFactor; }
+    /** Speed/size trade-off for PNG-encoding QImage variables: 0-9 selects the built-in encoder at that zlib level
+     *  (1, the default, is fastest; 4+ adds per-row filter selection for smaller files), -1 uses Qt's PNG plugin. */
+    void setPngCompressionLevel(int level) { m_pngCompressionLevel = level; }
+    int pngCompressionLevel() const { return m_pngCompressionLevel; }
     /** Return paragraph-joined plain text of the main document (paragraphs separated by \n). */
     QString readTextContent() const; // paragraphs joined by '\n'
     /** Non-greedy scan for placeholders matching prefix+suffix. Spans across run boundaries. Deduplicated, order of first appearance. */
@@ -49,6 +83,10 @@ public:
     QStringList validateTableColumnPlaceholders(const Variables &variables) const;
     /** Write resulting package to disk (zip). */
     void save(const QString &outputPath) const;
+    /** Write resulting package to device (opened WriteOnly if needed). Returns false and sets SaveFailed on error. */
+    bool save(QIODevice *device) const;
+    /** Return resulting package as an in-memory .docx; empty and SaveFailed set on error. */
+    QByteArray saveToByteArray() const;
 
     /** Last error code set during an operation; std::nullopt if none since construction or after successful clear. */
     std::optional<ErrorCode> lastError() const { return m_lastError; }
@@ -56,13 +94,33 @@ public:
     void clearError() { m_lastError.reset(); }
 
 private:
+    friend class TemplateCache;
+    qint64 memoryFootprint() const; // approximate bytes held by the opened package
+    struct FromDataTag {};
+    Docx(FromDataTag, QByteArray templateData);
+    struct ForkTag {};
+    Docx(ForkTag, const Docx &source);
     QString m_templatePath;
+    QByteArray m_templateData; // in-memory template (used when m_templatePath is empty)
     VariablePattern m_pattern;
+    CompressionPolicy m_compressionPolicy{CompressionPolicy::defaults()};
+    double m_imageDownscaleFactor{0.0};
+    int m_pngCompressionLevel{1};
     mutable std::shared_ptr<opc::Package> m_package; // OPC container (shared_ptr works with incomplete type)
     mutable bool m_openAttempted{false};
     mutable bool m_documentLoaded{false};
+    // Parsed XML parts, kept across operations and serialized back into the package only on save
+    struct ParsedPart {
+        std::shared_ptr<xml::XmlPart> xml; // null if the part failed to parse; shared with forks until written
+        bool dirty{false};                  // modified since last written to the package
+        qint64 sourceSize{0};               // serialized size, basis of the memory estimate
+    };
+    mutable QHash<QString, ParsedPart> m_parsedParts;
     bool ensureOpened() const; // lazy open helper
-    bool ensureDocumentLoaded() const; // load word/document.xml once
+    bool ensureDocumentLoaded() const; // parse word/document.xml once and check for w:body
+    const xml::XmlPart * parsedPart(const QString &partName) const; // parse on first use; nullptr if missing/invalid
+    xml::XmlPart * writablePart(const QString &partName); // parsedPart, copied first if shared with another instance
+    void flushParsedParts() const; // write modified DOMs back into the package
     void setError(ErrorCode ec) const { m_lastError = ec; }
 
     // Build paragraph-joined text (implementation detail shared by readTextContent & findVariables)
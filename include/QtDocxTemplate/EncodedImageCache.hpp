@@ -0,0 +1,62 @@
+/** \file EncodedImageCache.hpp
+ *  Optional process-wide cache of encoded image bytes shared by all Docx instances.
+ */
+#pragma once
+#include "QtDocxTemplate/Export.hpp"
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QSize>
+#include <list>
+#include <mutex>
+
+namespace QtDocxTemplate {
+
+/** Thread-safe LRU cache from (image, format, quality, target size) to encoded bytes, so the same image
+ *  (e.g. a company logo) is encoded once per process instead of once per document.
+ *  Disabled by default (budget 0); enable with setMemoryBudget(). Images are identified by QImage::cacheKey(),
+ *  or by a hash of their pixels with setKeyByContent(true) when equal images are created independently.
+ */
+class QTDOCTXTEMPLATE_EXPORT EncodedImageCache {
+public:
+    /** Shared process-wide instance (used by Docx::fillTemplate). */
+    static EncodedImageCache & instance();
+
+    explicit EncodedImageCache(qint64 memoryBudget = 0);
+    EncodedImageCache(const EncodedImageCache &) = delete;
+    EncodedImageCache & operator=(const EncodedImageCache &) = delete;
+
+    /** Maximum bytes of encoded data kept; 0 disables the cache and drops its content. */
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const;
+    bool enabled() const { return memoryBudget() > 0; }
+    /** Identify images by pixel content instead of QImage::cacheKey() (hashes each looked up image). */
+    void setKeyByContent(bool byContent);
+    bool keyByContent() const;
+
+    /** Cached bytes of image encoded as format/quality at size; empty on miss or when disabled. */
+    QByteArray find(const QImage &image, const QByteArray &format, int quality, const QSize &size);
+    /** Remember encoded bytes (no-op when disabled or larger than the budget). */
+    void insert(const QImage &image, const QByteArray &format, int quality, const QSize &size, const QByteArray &encoded);
+
+    qint64 memoryUsage() const;
+    int size() const;
+    void clear();
+
+private:
+    struct Entry {
+        QByteArray data;
+        std::list<QByteArray>::iterator lru;
+    };
+    QByteArray keyFor(const QImage &image, const QByteArray &format, int quality, const QSize &size) const;
+    void evict(); // requires m_mutex
+
+    mutable std::mutex m_mutex;
+    QHash<QByteArray, Entry> m_entries;
+    std::list<QByteArray> m_lru; // most recently used first
+    qint64 m_budget;
+    qint64 m_usage{0};
+    bool m_byContent{false};
+};
+
+} // namespace QtDocxTemplate
@@ -4,22 +4,51 @@
 #pragma once
 #include "QtDocxTemplate/Variable.hpp"
 #include <QImage>
+#include <QByteArray>
 
 namespace QtDocxTemplate {
 
-/** Stores an image and desired pixel size (converted to EMU @96DPI). */
+/** Stores an image and desired pixel size (converted to EMU @96DPI).
+ *  The image is either a QImage (encoded to PNG when embedded), already encoded bytes (embedded as-is, never
+ *  decoded) or an image file (streamed from disk into the saved package). Encoded bytes and files are kept
+ *  as-is only in formats Word takes as picture parts (PNG, JPEG, GIF, BMP, TIFF, EMF, WMF); other formats
+ *  Qt can read are decoded on construction and become Image sources.
+ */
 class QTDOCTXTEMPLATE_EXPORT ImageVariable : public Variable {
 public:
+    /** Where the image bytes come from. */
+    enum class Source { Image, Encoded, File };
+
     ImageVariable(QString key, QImage image, int widthPx, int heightPx)
         : Variable(std::move(key), VariableType::Image), m_image(std::move(image)), m_width(widthPx), m_height(heightPx) {}
-    /** Raw QImage copied into package media/ directory. */
+    /** Encoded image bytes; format is e.g. "png", "jpeg"/"jpg" or "gif" (detected from the data if empty).
+     *  Undecodable data in an unsupported format is never embedded: the placeholder is left in place. */
+    ImageVariable(QString key, QByteArray encoded, QString format, int widthPx, int heightPx);
+    /** Image file that stays on disk until save, when it is streamed into the package as-is. Only the file header
+     *  is read here: format and, for non-positive widthPx/heightPx, the pixel size. Files whose size Qt cannot read
+     *  (EMF, WMF, or formats without an image plugin) need an explicit size; otherwise the placeholder is left in place. */
+    static std::shared_ptr<ImageVariable> fromFile(QString key, const QString &filePath, int widthPx = 0, int heightPx = 0);
+    /** Source kind of this variable. */
+    Source source() const { return m_source; }
+    /** Raw QImage copied into package media/ directory (null for Encoded sources). */
     const QImage & image() const { return m_image; }
+    /** Encoded bytes embedded verbatim (Encoded sources only). */
+    const QByteArray & encodedData() const { return m_encoded; }
+    /** Path of the image file (File sources only). */
+    const QString & filePath() const { return m_filePath; }
+    /** Lower-case media extension of the encoded bytes or file (e.g. "png", "jpeg" or "gif"); empty for Image sources. */
+    const QString & format() const { return m_format; }
     /** Target width in pixels (not auto-scaled). */
     int widthPx() const { return m_width; }
     /** Target height in pixels. */
     int heightPx() const { return m_height; }
 private:
+    explicit ImageVariable(QString key) : Variable(std::move(key), VariableType::Image) {}
+    Source m_source{Source::Image};
     QImage m_image;
+    QByteArray m_encoded;
+    QString m_filePath;
+    QString m_format;
     int m_width{0};
     int m_height{0};
 };
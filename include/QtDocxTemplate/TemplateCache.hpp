@@ -0,0 +1,73 @@
+/** \file TemplateCache.hpp
+ *  Process-wide cache of opened, preloaded templates shared between threads.
+ */
+#pragma once
+#include "QtDocxTemplate/Export.hpp"
+#include "QtDocxTemplate/Docx.hpp"
+#include <QString>
+#include <QStringList>
+#include <QDateTime>
+#include <QHash>
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace QtDocxTemplate {
+
+/** Thread-safe LRU cache of templates keyed by canonical path, modification time and size.
+ *  Each entry holds a preloaded Docx (a copy of the archive bytes, inflated and parsed parts) plus its
+ *  placeholder list; acquire() hands out cheap forks of it, so repeated renders of the same template skip
+ *  all file I/O, decompression and parsing. A template changed on disk is reloaded on the next acquire();
+ *  forks already handed out keep using the old bytes. Entries are evicted least recently used
+ *  first once the memory budget is exceeded (the most recent entry is always kept).
+ */
+class QTDOCTXTEMPLATE_EXPORT TemplateCache {
+public:
+    /** Shared process-wide instance. */
+    static TemplateCache & instance();
+
+    /** New cache with the given memory budget in bytes (approximate: archive bytes + inflated and parsed parts). */
+    explicit TemplateCache(qint64 memoryBudget = 256 * 1024 * 1024);
+    TemplateCache(const TemplateCache &) = delete;
+    TemplateCache & operator=(const TemplateCache &) = delete;
+
+    /** Fork of the cached template for path, loading it on miss. If the template cannot be opened, an
+     *  uncached Docx(path) is returned (its first operation reports OpenFailed).
+     */
+    Docx acquire(const QString &path);
+    /** Placeholders found in the cached template (see Docx::findVariables), loading it on miss. */
+    QStringList variables(const QString &path);
+    /** Load paths in parallel on the global thread pool; returns how many are cached afterwards. */
+    int warmUp(const QStringList &paths);
+    /** Load every *.docx in directory (non-recursive) in parallel; returns how many are cached afterwards. */
+    int warmUpDirectory(const QString &directory);
+
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const;
+    /** Approximate bytes held by cached entries. */
+    qint64 memoryUsage() const;
+    int size() const;
+    /** Drop one template (e.g. after replacing it) or all of them. Outstanding forks stay valid. */
+    void remove(const QString &path);
+    void clear();
+
+private:
+    struct Entry {
+        QDateTime modified;
+        qint64 fileSize{0};
+        qint64 cost{0};
+        std::shared_ptr<const Docx> docx; // preloaded, never modified after insertion
+        QStringList variables;
+        std::list<QString>::iterator lru;
+    };
+    std::shared_ptr<const Entry> lookup(const QString &path); // cached or freshly loaded entry; nullptr on failure
+    void evict(); // requires m_mutex
+
+    mutable std::mutex m_mutex;
+    QHash<QString, std::shared_ptr<Entry>> m_entries; // canonical path -> entry
+    std::list<QString> m_lru; // most recently used first
+    qint64 m_budget;
+    qint64 m_usage{0};
+};
+
+} // namespace QtDocxTemplate
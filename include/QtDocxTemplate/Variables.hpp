@@ -5,6 +5,7 @@
 #include "QtDocxTemplate/Variable.hpp"
 #include <vector>
 #include <QImage>
+#include <QByteArray>
 #include "QtDocxTemplate/TableVariable.hpp"
 
 namespace QtDocxTemplate {
@@ -22,6 +23,10 @@ public:
     VariablePtr addImage(const QString &key, const QImage &image, int wPx, int hPx);
     /** Alias for templ4docx style (parity). */
     VariablePtr addImageVariable(const QString &key, const QImage &image, int wPx, int hPx) { return addImage(key, image, wPx, hPx); }
+    /** Convenience: create and add an ImageVariable from already encoded PNG/JPEG/GIF bytes (embedded without re-encoding). */
+    VariablePtr addEncodedImage(const QString &key, const QByteArray &encoded, const QString &format, int wPx, int hPx);
+    /** Convenience: create and add a file-backed ImageVariable (streamed from disk on save; size read from the file if 0). */
+    VariablePtr addImageFile(const QString &key, const QString &filePath, int wPx = 0, int hPx = 0);
     /** Convenience: create and add a BulletListVariable with given item texts (each becomes a TextVariable). */
     VariablePtr addBulletList(const QString &key, const QStringList &items);
     /** Alias for templ4docx style (parity). */
@@ -11,6 +11,14 @@ std::shared_ptr<ImageVariable> makeImageVar(const QString &keyOrName, const QIma
     return std::make_shared<ImageVariable>(ensureWrapped(keyOrName, pat), img, wPx, hPx);
 }
 
+std::shared_ptr<ImageVariable> makeEncodedImageVar(const QString &keyOrName, const QByteArray &encoded, const QString &format, int wPx, int hPx, const VariablePattern &pat){
+    return std::make_shared<ImageVariable>(ensureWrapped(keyOrName, pat), encoded, format, wPx, hPx);
+}
+
+std::shared_ptr<ImageVariable> makeImageFileVar(const QString &keyOrName, const QString &filePath, int wPx, int hPx, const VariablePattern &pat){
+    return ImageVariable::fromFile(ensureWrapped(keyOrName, pat), filePath, wPx, hPx);
+}
+
 std::shared_ptr<BulletListVariable> makeBulletListVar(const QString &keyOrName, const QStringList &items, const VariablePattern &pat){
     auto bl = std::make_shared<BulletListVariable>(ensureWrapped(keyOrName, pat));
     for(const auto &t : items){
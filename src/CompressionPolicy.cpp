@@ -0,0 +1,74 @@
+#include "QtDocxTemplate/CompressionPolicy.hpp"
+#include <algorithm>
+
+namespace QtDocxTemplate {
+
+namespace {
+// Levels outside the backend's range make the deflater fail (and the part could not be saved)
+CompressionPolicy::Setting clamped(CompressionPolicy::Setting setting) {
+    setting.level = std::clamp(setting.level, 0, CompressionPolicy::maxLevel());
+    return setting;
+}
+
+QRegularExpression wildcardRegex(const QString &pattern) {
+    QString re;
+    for(const QChar c : pattern) {
+        if(c == '*') re += QStringLiteral(".*");
+        else if(c == '?') re += '.';
+        else re += QRegularExpression::escape(QString(c));
+    }
+    return QRegularExpression(QRegularExpression::anchoredPattern(re), QRegularExpression::CaseInsensitiveOption);
+}
+} // namespace
+
+int CompressionPolicy::maxLevel() {
+#ifdef QTDOCTEMPLATE_USE_LIBDEFLATE
+    return 12;
+#else
+    return 9;
+#endif
+}
+
+CompressionPolicy CompressionPolicy::defaults() {
+    const Setting store{Method::Store, 0};
+    const Setting fastXml{Method::Deflate, 1};
+    CompressionPolicy p;
+    p.addContentTypeRule(QStringLiteral("image/png"), store)
+     .addContentTypeRule(QStringLiteral("image/jpeg"), store)
+     .addContentTypeRule(QStringLiteral("image/gif"), store)
+     .addContentTypeRule(QStringLiteral("audio/*"), store)
+     .addContentTypeRule(QStringLiteral("video/*"), store)
+     .addContentTypeRule(QStringLiteral("*/xml"), fastXml)
+     .addContentTypeRule(QStringLiteral("*+xml"), fastXml)
+     .addPartRule(QStringLiteral("*.xml"), fastXml)
+     .addPartRule(QStringLiteral("*.rels"), fastXml);
+    return p;
+}
+
+CompressionPolicy & CompressionPolicy::addPartRule(const QString &partPattern, Setting setting) {
+    QString pat = partPattern;
+    if(pat.startsWith('/')) pat.remove(0, 1);
+    m_rules.push_back({false, wildcardRegex(pat), clamped(setting)});
+    return *this;
+}
+
+CompressionPolicy & CompressionPolicy::addContentTypeRule(const QString &contentTypePattern, Setting setting) {
+    m_rules.push_back({true, wildcardRegex(contentTypePattern), clamped(setting)});
+    return *this;
+}
+
+void CompressionPolicy::setFallback(Setting setting) {
+    m_fallback = clamped(setting);
+}
+
+CompressionPolicy::Setting CompressionPolicy::settingFor(const QString &partName, const QString &contentType) const {
+    for(auto it = m_rules.rbegin(); it != m_rules.rend(); ++it) {
+        const Rule &r = *it;
+        const QString &subject = r.byContentType ? contentType : partName;
+        if(subject.isEmpty()) continue;
+        if(r.re.match(subject).hasMatch()) return r.setting;
+    }
+    return m_fallback;
+}
+
+} // namespace QtDocxTemplate
@@ -1,21 +1,35 @@
 #include "QtDocxTemplate/Docx.hpp"
 #include <QFile>
+#include <QIODevice>
 #include "opc/Package.hpp"
 #include "xml/XmlPart.hpp"
+#include "xml/DocumentIndex.hpp"
 #include "engine/Replacers.hpp"
+#include "engine/PlaceholderMatcher.hpp"
+#include "engine/ImageEncoder.hpp"
 #include "QtDocxTemplate/Variables.hpp"
 #include <QRegularExpression>
 
 namespace QtDocxTemplate {
 
+namespace {
+// Main document followed by headers and footers (names straight from the package index)
+QStringList contentPartNames(const opc::Package &pkg) {
+    using Kind = opc::Package::PartKind;
+    return pkg.partNames(Kind::MainDocument) + pkg.partNames(Kind::Header) + pkg.partNames(Kind::Footer);
+}
+} // namespace
+
 bool Docx::ensureOpened() const {
     if(m_openAttempted) return m_package != nullptr;
     m_openAttempted = true;
     auto pkg = std::make_shared<opc::Package>();
-    if(!pkg->open(m_templatePath)) {
+    bool opened = m_templatePath.isEmpty() ? pkg->openData(m_templateData) : pkg->open(m_templatePath);
+    if(!opened) {
     setError(ErrorCode::OpenFailed);
         return false;
     }
+    pkg->setCompressionPolicy(m_compressionPolicy);
     m_package = std::move(pkg);
     return true;
 }
@@ -23,47 +37,115 @@ bool Docx::ensureOpened() const {
 bool Docx::ensureDocumentLoaded() const {
     if(!ensureOpened()) return false;
     if(m_documentLoaded) return true;
-    // Lazy include of XmlPart header structure: we can't forward declare internal storage, so we store in a lambda-local static.
-    // For now we parse on demand each call to readTextContent; simple implementation approach.
+    if(!m_package->hasPart(QStringLiteral("word/document.xml"))) { setError(ErrorCode::DocumentPartMissing); return false; }
+    const xml::XmlPart *part = parsedPart(QStringLiteral("word/document.xml"));
+    // Structural validation: require w:body
+    if(!part || part->selectAll("//w:body").empty()) { setError(ErrorCode::XmlParseFailed); return false; }
+    m_documentLoaded = true;
     return true;
 }
 
+const xml::XmlPart * Docx::parsedPart(const QString &partName) const {
+    auto it = m_parsedParts.find(partName);
+    if(it != m_parsedParts.end()) return it.value().xml.get();
+    ParsedPart parsed;
+    if(auto data = m_package->releasePart(partName)) { // DOM becomes the live copy; parse without a copy
+        parsed.sourceSize = data->size();
+        auto part = std::make_shared<xml::XmlPart>();
+        if(part->loadInPlace(std::move(*data))) parsed.xml = std::move(part);
+    }
+    return m_parsedParts.insert(partName, parsed).value().xml.get();
+}
+
+xml::XmlPart * Docx::writablePart(const QString &partName) {
+    if(!parsedPart(partName)) return nullptr;
+    auto &xml = m_parsedParts[partName].xml;
+    // Still shared with the instance it was forked from (or with its other forks): copy before modifying
+    if(xml.use_count() > 1) {
+        auto copy = std::make_shared<xml::XmlPart>();
+        copy->copyFrom(*xml);
+        xml = std::move(copy);
+    }
+    return xml.get();
+}
+
+void Docx::flushParsedParts() const {
+    for(auto it = m_parsedParts.begin(); it != m_parsedParts.end(); ++it) {
+        if(!it.value().dirty || !it.value().xml) continue;
+        m_package->writePart(it.key(), it.value().xml->save());
+        it.value().dirty = false;
+    }
+}
+
 QString Docx::readFullTextCache() const {
-    if(!ensureOpened()) return {};
-    // Load document.xml
-    auto dataOpt = m_package->readPart("word/document.xml");
-    if(!dataOpt) { setError(ErrorCode::DocumentPartMissing); return {}; }
-    xml::XmlPart part;
-    if(!part.load(*dataOpt)) { setError(ErrorCode::XmlParseFailed); return {}; }
-    // Structural validation: require w:body
-    if(part.selectAll("//w:body").empty()) { setError(ErrorCode::XmlParseFailed); return {}; }
+    if(!ensureDocumentLoaded()) return {};
+    const xml::XmlPart &part = *parsedPart(QStringLiteral("word/document.xml"));
+    xml::DocumentIndex index; index.build(part.doc());
     QStringList paragraphLines;
-    auto paragraphs = part.selectAll("//w:p");
-    for(const auto &p : paragraphs) {
-        QString paraText;
-        // Collect all descendant w:t in order
-        pugi::xpath_query textQuery(".//w:t");
-        auto ts = textQuery.evaluate_node_set(p);
-        for(const auto &tn : ts) {
-            pugi::xml_node node = tn.node();
-            // Respect xml:space="preserve" (we just take text as-is)
-            QString t = QString::fromUtf8(node.text().get());
-            paraText += t;
-        }
-        paragraphLines << paraText;
-    }
+    paragraphLines.reserve(static_cast<qsizetype>(index.paragraphs().size()));
+    // Text as-is, xml:space="preserve" or not
+    for(const auto &p : index.paragraphs()) paragraphLines << index.paragraphText(p);
     return paragraphLines.join('\n');
 }
 
 Docx::Docx(QString templatePath)
     : m_templatePath(std::move(templatePath)) {}
 
+Docx::Docx(QIODevice *device) {
+    if(device && (device->isOpen() || device->open(QIODevice::ReadOnly))) m_templateData = device->readAll();
+}
+
+Docx::Docx(FromDataTag, QByteArray templateData)
+    : m_templateData(std::move(templateData)) {}
+
+Docx Docx::fromData(const QByteArray &templateData) {
+    return Docx(FromDataTag{}, templateData);
+}
+
+Docx::Docx(ForkTag, const Docx &source)
+    : m_templatePath(source.m_templatePath),
+      m_templateData(source.m_templateData),
+      m_pattern(source.m_pattern),
+      m_compressionPolicy(source.m_compressionPolicy),
+      m_imageDownscaleFactor(source.m_imageDownscaleFactor),
+      m_pngCompressionLevel(source.m_pngCompressionLevel),
+      m_openAttempted(source.m_openAttempted) {
+    // Unopened or failed sources fork into an instance that opens lazily itself (and reports the same errors)
+    if(source.m_package) m_package = source.m_package->clone();
+    else m_openAttempted = false;
+    // Share parsed parts instead of inflating and parsing again; writablePart copies one before a fill changes it
+    m_parsedParts = source.m_parsedParts;
+}
+
+Docx Docx::fork() const {
+    return Docx(ForkTag{}, *this);
+}
+
+bool Docx::preload() const {
+    if(!ensureOpened()) return false;
+    m_package->preloadXmlParts();
+    for(const auto &name : contentPartNames(*m_package)) parsedPart(name);
+    return true;
+}
+
+qint64 Docx::memoryFootprint() const {
+    qint64 total = m_package ? m_package->memoryFootprint() : m_templateData.size(); // package shares m_templateData
+    // Parsed parts: source text kept in situ plus roughly as much again for the node tree
+    for(const auto &parsed : m_parsedParts) total += parsed.sourceSize * 2;
+    return total;
+}
+
 Docx::~Docx() = default;
 
 void Docx::setVariablePattern(const VariablePattern &pattern) {
     m_pattern = pattern;
 }
 
+void Docx::setCompressionPolicy(const CompressionPolicy &policy) {
+    m_compressionPolicy = policy;
+    if(m_package) m_package->setCompressionPolicy(policy);
+}
+
 QString Docx::readTextContent() const {
     return readFullTextCache();
 }
@@ -92,42 +174,66 @@ QStringList Docx::findVariables() const {
 void Docx::fillTemplate(const Variables &variables) {
     if(!ensureOpened()) return;
     clearError();
-    // Build list of document parts to process: main doc + headers + footers
-    QStringList targets;
-    targets << "word/document.xml";
-    for(const auto &rawName : m_package->partNames()) {
-        QString name = rawName;
-        if(name.startsWith('/')) name = name.mid(1); // normalize possible leading slash
-        if((name.startsWith("word/header") || name.contains("/word/header")) && name.endsWith(".xml")) targets << name;
-        else if((name.startsWith("word/footer") || name.contains("/word/footer")) && name.endsWith(".xml")) targets << name;
-    }
-    targets.removeDuplicates();
+    // Document parts to process: main doc + headers + footers
+    const QStringList targets = contentPartNames(*m_package);
+    // One structural walk per part; the fill pass works from its paragraph/table index
+    std::vector<std::pair<QString, xml::DocumentIndex>> parts;
     for(const auto &partName : targets) {
-        auto dataOpt = m_package->readPart(partName);
-        if(!dataOpt) continue;
-        xml::XmlPart part;
-    if(!part.load(*dataOpt)) { setError(ErrorCode::XmlParseFailed); continue; }
+        const xml::XmlPart *part = parsedPart(partName);
+        if(!part) { setError(ErrorCode::XmlParseFailed); continue; }
         // Only enforce presence of w:body for the main document part; headers/footers have w:hdr / w:ftr roots.
-        if(partName == "word/document.xml" && part.selectAll("//w:body").empty()) {
+        if(partName == QLatin1String("word/document.xml") && part->selectAll("//w:body").empty()) {
             setError(ErrorCode::XmlParseFailed);
             continue;
         }
-        engine::Replacers::replaceText(part.doc(), m_pattern.prefix, m_pattern.suffix, variables);
-        engine::Replacers::replaceImages(part.doc(), *m_package, m_pattern.prefix, m_pattern.suffix, variables);
-        engine::Replacers::replaceBulletLists(part.doc(), *m_package, m_pattern.prefix, m_pattern.suffix, variables);
-    bool mismatch = engine::Replacers::replaceTables(part.doc(), *m_package, m_pattern.prefix, m_pattern.suffix, variables);
-    if(mismatch && !m_lastError.has_value()) setError(ErrorCode::TableColumnLengthMismatch);
-        QByteArray out = part.save();
-        m_package->writePart(partName, out);
+        parts.emplace_back(partName, xml::DocumentIndex());
+        parts.back().second.build(part->doc());
+    }
+    // Encode referenced QImages concurrently before touching the DOM
+    engine::EncodedImages encoded;
+    encoded.options.downscaleFactor = m_imageDownscaleFactor;
+    encoded.options.pngLevel = m_pngCompressionLevel;
+    auto jobs = engine::ImageEncoder::collect(variables, *m_package, encoded.options);
+    if(!jobs.empty()) {
+        QString text;
+        for(const auto &entry : parts) {
+            for(const auto &tn : entry.second.texts()) text += QString::fromUtf8(tn.text().get());
+        }
+        encoded = engine::ImageEncoder::encode(jobs, text, encoded.options);
+    }
+    const engine::PlaceholderMatcher matcher(variables, m_pattern.prefix, m_pattern.suffix); // all keys, once per fill
+    for(auto &entry : parts) {
+        const QString &partName = entry.first;
+        // Parts without a single known placeholder are left as they are (and shared with forks)
+        if(!engine::Replacers::hasPlaceholders(entry.second, matcher)) continue;
+        const xml::XmlPart *shared = parsedPart(partName);
+        xml::XmlPart *part = writablePart(partName);
+        if(part != shared) entry.second.build(part->doc()); // index the private copy
+        const auto result = engine::Replacers::fill(entry.second, *m_package, partName, matcher, encoded);
+        if(result.mismatch && !m_lastError.has_value()) setError(ErrorCode::TableColumnLengthMismatch);
+        if(result.modified) m_parsedParts[partName].dirty = true; // serialized on save; others stay raw copies
     }
 }
 
 void Docx::save(const QString &outputPath) const {
-    Q_UNUSED(outputPath);
     if(!ensureOpened()) return;
-    if(m_package) {
-        m_package->saveAs(outputPath);
-    }
+    flushParsedParts();
+    if(m_package && !m_package->saveAs(outputPath)) setError(ErrorCode::SaveFailed);
+}
+
+bool Docx::save(QIODevice *device) const {
+    if(!ensureOpened()) return false;
+    flushParsedParts();
+    if(!m_package->saveTo(device)) { setError(ErrorCode::SaveFailed); return false; }
+    return true;
+}
+
+QByteArray Docx::saveToByteArray() const {
+    if(!ensureOpened()) return {};
+    flushParsedParts();
+    auto data = m_package->saveToData();
+    if(!data) { setError(ErrorCode::SaveFailed); return {}; }
+    return *data;
 }
 
 QStringList Docx::validateTableColumnPlaceholders(const Variables &variables) const {
@@ -149,20 +255,11 @@ QStringList Docx::validateTableColumnPlaceholders(const Variables &variables) co
     }
     if(required.isEmpty()) return missing;
     // Gather text from all relevant parts
-    QStringList partNames; partNames << "word/document.xml";
-    for(const auto &rawName : m_package->partNames()) {
-        QString name = rawName; if(name.startsWith('/')) name = name.mid(1);
-        if((name.startsWith("word/header") || name.contains("/word/header")) && name.endsWith(".xml")) partNames << name;
-        else if((name.startsWith("word/footer") || name.contains("/word/footer")) && name.endsWith(".xml")) partNames << name;
-    }
-    partNames.removeDuplicates();
-    for(const auto &pn : partNames) {
-        auto dataOpt = m_package->readPart(pn); if(!dataOpt) continue;
-        xml::XmlPart part; if(!part.load(*dataOpt)) continue;
-        auto paragraphs = part.selectAll("//w:p");
-        for(const auto &p : paragraphs) {
-            QString paraText; pugi::xpath_query textQuery(".//w:t"); auto ts = textQuery.evaluate_node_set(p);
-            for(const auto &tn : ts) { pugi::xml_node node = tn.node(); paraText += QString::fromUtf8(node.text().get()); }
+    for(const auto &pn : contentPartNames(*m_package)) {
+        const xml::XmlPart *part = parsedPart(pn); if(!part) continue;
+        xml::DocumentIndex index; index.build(part->doc());
+        for(const auto &p : index.paragraphs()) {
+            QString paraText = index.paragraphText(p);
             for(const auto &req : required) if(paraText.contains(req)) present.insert(req);
         }
     }
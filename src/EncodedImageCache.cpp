@@ -0,0 +1,107 @@
+#include "QtDocxTemplate/EncodedImageCache.hpp"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <algorithm>
+
+namespace QtDocxTemplate {
+
+EncodedImageCache & EncodedImageCache::instance() {
+    static EncodedImageCache cache;
+    return cache;
+}
+
+EncodedImageCache::EncodedImageCache(qint64 memoryBudget)
+    : m_budget(memoryBudget) {}
+
+QByteArray EncodedImageCache::keyFor(const QImage &image, const QByteArray &format, int quality, const QSize &size) const {
+    QByteArray key;
+    QDataStream ds(&key, QIODevice::WriteOnly);
+    if(keyByContent()) {
+        // Hash visible scanline bytes only (padding is not part of the image)
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        const qsizetype lineBytes = (qsizetype(image.width()) * image.depth() + 7) / 8;
+        for(int y = 0; y < image.height(); ++y) hash.addData(QByteArrayView(reinterpret_cast<const char*>(image.constScanLine(y)), lineBytes));
+        // Indexed and mono images: the same indices with another palette are different pixels
+        if(image.colorCount() > 0) {
+            const QList<QRgb> colors = image.colorTable();
+            hash.addData(QByteArrayView(reinterpret_cast<const char*>(colors.constData()), colors.size() * qsizetype(sizeof(QRgb))));
+        }
+        ds << hash.result() << int(image.format()) << image.size() << image.dotsPerMeterX() << image.dotsPerMeterY();
+    } else {
+        ds << image.cacheKey();
+    }
+    ds << format << quality << size;
+    return key;
+}
+
+QByteArray EncodedImageCache::find(const QImage &image, const QByteArray &format, int quality, const QSize &size) {
+    if(!enabled() || image.isNull()) return {};
+    const QByteArray key = keyFor(image, format, quality, size);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if(it == m_entries.end()) return {};
+    m_lru.splice(m_lru.begin(), m_lru, it.value().lru);
+    return it.value().data;
+}
+
+void EncodedImageCache::insert(const QImage &image, const QByteArray &format, int quality, const QSize &size, const QByteArray &encoded) {
+    if(!enabled() || image.isNull() || encoded.isEmpty()) return;
+    const QByteArray key = keyFor(image, format, quality, size);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(encoded.size() > m_budget || m_entries.contains(key)) return;
+    m_lru.push_front(key);
+    m_entries.insert(key, {encoded, m_lru.begin()});
+    m_usage += encoded.size();
+    evict();
+}
+
+void EncodedImageCache::evict() {
+    while(m_usage > m_budget && !m_lru.empty()) {
+        auto it = m_entries.find(m_lru.back());
+        m_usage -= it.value().data.size();
+        m_entries.erase(it);
+        m_lru.pop_back();
+    }
+}
+
+void EncodedImageCache::setMemoryBudget(qint64 bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = std::max<qint64>(bytes, 0);
+    evict();
+}
+
+qint64 EncodedImageCache::memoryBudget() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+void EncodedImageCache::setKeyByContent(bool byContent) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_byContent == byContent) return;
+    m_byContent = byContent;
+    m_entries.clear(); m_lru.clear(); m_usage = 0; // keys of the other kind would never match again
+}
+
+bool EncodedImageCache::keyByContent() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_byContent;
+}
+
+qint64 EncodedImageCache::memoryUsage() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_usage;
+}
+
+int EncodedImageCache::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+void EncodedImageCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_lru.clear();
+    m_usage = 0;
+}
+
+} // namespace QtDocxTemplate
@@ -1,2 +1,70 @@
 #include "QtDocxTemplate/ImageVariable.hpp"
-namespace QtDocxTemplate { /* ImageVariable inline */ }
+#include "opc/Package.hpp"
+#include <QBuffer>
+#include <QImageReader>
+#include <QDebug>
+
+namespace QtDocxTemplate {
+
+namespace {
+// Formats that can go into the package verbatim (they have a media content type)
+bool embeddable(const QString &format) {
+    return !format.isEmpty() && !opc::Package::mediaContentType(format).isEmpty();
+}
+} // namespace
+
+ImageVariable::ImageVariable(QString key, QByteArray encoded, QString format, int widthPx, int heightPx)
+    : Variable(std::move(key), VariableType::Image), m_source(Source::Encoded), m_encoded(std::move(encoded)),
+      m_format(format.toLower()), m_width(widthPx), m_height(heightPx) {
+    if(m_format.startsWith('.')) m_format.remove(0, 1);
+    if(m_format.isEmpty()) {
+        // Sniff the header only; the image is not decoded
+        QBuffer buf(&m_encoded); buf.open(QIODevice::ReadOnly);
+        m_format = QString::fromLatin1(QImageReader::imageFormat(&buf)).toLower();
+    }
+    if(m_format == QLatin1String("jpg")) m_format = QStringLiteral("jpeg");
+    if(embeddable(m_format)) return;
+    // Anything else (webp, svg, ... or unrecognised bytes) is decoded now and embedded as PNG
+    QImage image;
+    if(!image.loadFromData(m_encoded, m_format.isEmpty() ? nullptr : m_format.toLatin1().constData())) {
+        qWarning() << "ImageVariable: cannot decode image data for" << this->key();
+        m_format.clear(); // not embedded; the placeholder is left in place
+        return;
+    }
+    m_source = Source::Image;
+    m_image = std::move(image);
+    m_encoded.clear();
+    m_format.clear();
+}
+
+std::shared_ptr<ImageVariable> ImageVariable::fromFile(QString key, const QString &filePath, int widthPx, int heightPx) {
+    std::shared_ptr<ImageVariable> v(new ImageVariable(std::move(key)));
+    v->m_source = Source::File;
+    v->m_filePath = filePath;
+    QImageReader reader(filePath); // header only
+    v->m_format = QString::fromLatin1(reader.format()).toLower();
+    if(v->m_format == QLatin1String("jpg")) v->m_format = QStringLiteral("jpeg");
+    if(!v->m_format.isEmpty() && !embeddable(v->m_format)) {
+        // Readable but not streamable as-is: decode it now and embed it as PNG like a QImage
+        v->m_source = Source::Image;
+        v->m_filePath.clear();
+        v->m_format.clear();
+        v->m_image = reader.read();
+        if(v->m_image.isNull()) qWarning() << "ImageVariable: cannot read image file" << filePath;
+        v->m_width = widthPx > 0 ? widthPx : v->m_image.width();
+        v->m_height = heightPx > 0 ? heightPx : v->m_image.height();
+        return v;
+    }
+    QSize size = (widthPx > 0 && heightPx > 0) ? QSize() : reader.size();
+    v->m_width = widthPx > 0 ? widthPx : size.width();
+    v->m_height = heightPx > 0 ? heightPx : size.height();
+    if(v->m_width <= 0 || v->m_height <= 0) {
+        // EMF/WMF, or a format without a Qt image plugin: the header gives no size to place the picture with
+        qWarning() << "ImageVariable: cannot read the pixel size of" << filePath << "- pass widthPx and heightPx";
+        v->m_filePath.clear(); // not embedded; the placeholder is left in place
+        v->m_format.clear();
+    }
+    return v;
+}
+
+} // namespace QtDocxTemplate
@@ -0,0 +1,137 @@
+#include "QtDocxTemplate/TemplateCache.hpp"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtConcurrent/QtConcurrentMap>
+#include <vector>
+
+namespace QtDocxTemplate {
+
+TemplateCache & TemplateCache::instance() {
+    static TemplateCache cache;
+    return cache;
+}
+
+TemplateCache::TemplateCache(qint64 memoryBudget)
+    : m_budget(memoryBudget) {}
+
+std::shared_ptr<const TemplateCache::Entry> TemplateCache::lookup(const QString &path) {
+    QFileInfo info(path);
+    const QString key = info.canonicalFilePath();
+    if(key.isEmpty()) return nullptr; // missing file
+    const QDateTime modified = info.lastModified();
+    const qint64 fileSize = info.size();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if(it != m_entries.end() && it.value()->modified == modified && it.value()->fileSize == fileSize) {
+            m_lru.splice(m_lru.begin(), m_lru, it.value()->lru);
+            return it.value();
+        }
+    }
+    // Load outside the lock; concurrent misses for the same template may both load, the last one wins.
+    // The entry owns a copy of the archive rather than a mapping of the file: forks read untouched parts
+    // from it long after this, and the template may be overwritten in place meanwhile.
+    QFile file(key);
+    if(!file.open(QIODevice::ReadOnly)) return nullptr;
+    std::shared_ptr<Docx> docx(new Docx(Docx::FromDataTag{}, file.readAll()));
+    file.close();
+    if(!docx->preload()) return nullptr;
+    auto entry = std::make_shared<Entry>();
+    entry->modified = modified;
+    entry->fileSize = fileSize;
+    entry->variables = docx->findVariables();
+    entry->cost = docx->memoryFootprint();
+    entry->docx = std::move(docx);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if(it != m_entries.end()) {
+        m_usage -= it.value()->cost;
+        m_lru.erase(it.value()->lru);
+    }
+    m_lru.push_front(key);
+    entry->lru = m_lru.begin();
+    m_usage += entry->cost;
+    m_entries.insert(key, entry);
+    evict();
+    return entry;
+}
+
+void TemplateCache::evict() {
+    while(m_usage > m_budget && m_lru.size() > 1) {
+        auto it = m_entries.find(m_lru.back());
+        m_usage -= it.value()->cost;
+        m_entries.erase(it);
+        m_lru.pop_back();
+    }
+}
+
+Docx TemplateCache::acquire(const QString &path) {
+    auto entry = lookup(path);
+    if(!entry) return Docx(path);
+    return entry->docx->fork();
+}
+
+QStringList TemplateCache::variables(const QString &path) {
+    auto entry = lookup(path);
+    return entry ? entry->variables : QStringList{};
+}
+
+int TemplateCache::warmUp(const QStringList &paths) {
+    std::vector<QString> jobs(paths.begin(), paths.end());
+    std::vector<char> loaded(jobs.size(), 0);
+    QtConcurrent::blockedMap(jobs, [this, &jobs, &loaded](const QString &p) {
+        loaded[static_cast<size_t>(&p - jobs.data())] = lookup(p) != nullptr;
+    });
+    int count = 0;
+    for(char ok : loaded) count += ok ? 1 : 0;
+    return count;
+}
+
+int TemplateCache::warmUpDirectory(const QString &directory) {
+    QDir dir(directory);
+    QStringList paths;
+    for(const QFileInfo &fi : dir.entryInfoList({QStringLiteral("*.docx")}, QDir::Files | QDir::Readable)) paths << fi.filePath();
+    return warmUp(paths);
+}
+
+void TemplateCache::setMemoryBudget(qint64 bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = bytes;
+    evict();
+}
+
+qint64 TemplateCache::memoryBudget() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+qint64 TemplateCache::memoryUsage() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_usage;
+}
+
+int TemplateCache::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+void TemplateCache::remove(const QString &path) {
+    const QString key = QFileInfo(path).canonicalFilePath();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if(it == m_entries.end()) return;
+    m_usage -= it.value()->cost;
+    m_lru.erase(it.value()->lru);
+    m_entries.erase(it);
+}
+
+void TemplateCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_lru.clear();
+    m_usage = 0;
+}
+
+} // namespace QtDocxTemplate
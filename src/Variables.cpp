@@ -20,6 +20,16 @@ VariablePtr Variables::addImage(const QString &key, const QImage &image, int wPx
     add(v); return v;
 }
 
+VariablePtr Variables::addEncodedImage(const QString &key, const QByteArray &encoded, const QString &format, int wPx, int hPx) {
+    auto v = std::make_shared<ImageVariable>(key, encoded, format, wPx, hPx);
+    add(v); return v;
+}
+
+VariablePtr Variables::addImageFile(const QString &key, const QString &filePath, int wPx, int hPx) {
+    auto v = ImageVariable::fromFile(key, filePath, wPx, hPx);
+    add(v); return v;
+}
+
 VariablePtr Variables::addBulletList(const QString &key, const QStringList &items) {
     auto bl = std::make_shared<BulletListVariable>(key);
     for(const auto &t : items) bl->addItem(std::make_shared<TextVariable>(QStringLiteral("ignored"), t));
@@ -0,0 +1,76 @@
+#include "engine/ImageEncoder.hpp"
+#include "QtDocxTemplate/ImageVariable.hpp"
+#include "QtDocxTemplate/TableVariable.hpp"
+#include "QtDocxTemplate/EncodedImageCache.hpp"
+#include "engine/PngEncoder.hpp"
+#include <QBuffer>
+#include <QSet>
+#include <QtConcurrent/QtConcurrentMap>
+#include <cmath>
+
+namespace QtDocxTemplate { namespace engine {
+
+QSize ImageEncoder::targetSize(const QImage &image, int widthPx, int heightPx, const Options &options) {
+	if(options.downscaleFactor <= 0.0 || widthPx <= 0 || heightPx <= 0) return image.size();
+	QSize placed(qMax(1, int(std::ceil(widthPx * options.downscaleFactor))), qMax(1, int(std::ceil(heightPx * options.downscaleFactor))));
+	// Only ever shrink: the drawing extent stretches the bitmap anyway
+	if(placed.width() >= image.width() && placed.height() >= image.height()) return image.size();
+	return placed.boundedTo(image.size());
+}
+
+QByteArray ImageEncoder::sourceKey(const QImage &image, const QSize &size) {
+	return QByteArray::number(image.cacheKey()) + '@' + QByteArray::number(size.width()) + 'x' + QByteArray::number(size.height());
+}
+
+std::vector<ImageEncoder::Job> ImageEncoder::collect(const ::QtDocxTemplate::Variables &vars, const opc::Package &pkg, const Options &options) {
+	std::vector<Job> jobs;
+	QSet<QByteArray> seen;
+	auto consider = [&](const Variable &v, const QString &key) {
+		if(v.type() != VariableType::Image) return;
+		const auto &iv = static_cast<const ImageVariable&>(v);
+		if(iv.source() != ImageVariable::Source::Image || iv.image().isNull()) return;
+		QSize size = targetSize(iv.image(), iv.widthPx(), iv.heightPx(), options);
+		QByteArray skey = sourceKey(iv.image(), size);
+		if(seen.contains(skey) || !pkg.mediaForSourceKey(skey).isEmpty()) return;
+		seen.insert(skey);
+		jobs.push_back({key, iv.image(), size, skey});
+	};
+	for(const auto &v : vars.all()) {
+		if(v->type() == VariableType::Table) {
+			const auto *tv = static_cast<const TableVariable*>(v.get());
+			for(size_t ci = 0; ci < tv->columns().size(); ++ci) {
+				for(const auto &cell : tv->columns()[ci]) consider(*cell, tv->placeholderKeys()[ci]);
+			}
+		} else {
+			consider(*v, v->key());
+		}
+	}
+	return jobs;
+}
+
+EncodedImages ImageEncoder::encode(const std::vector<Job> &jobs, const QString &text, const Options &options) {
+	struct Work { const Job *job; QByteArray png; };
+	std::vector<Work> work;
+	for(const auto &job : jobs) if(text.contains(job.key)) work.push_back({&job, {}});
+	QtConcurrent::blockedMap(work, [&options](Work &w) { w.png = encodePng(w.job->image, w.job->size, options); });
+	EncodedImages encoded;
+	encoded.options = options;
+	encoded.bytes.reserve(static_cast<qsizetype>(work.size()));
+	for(auto &w : work) if(!w.png.isEmpty()) encoded.bytes.insert(w.job->sourceKey, std::move(w.png));
+	return encoded;
+}
+
+QByteArray ImageEncoder::encodePng(const QImage &image, const QSize &size, const Options &options) {
+	auto &cache = EncodedImageCache::instance();
+	const QByteArray format("png");
+	QByteArray png = cache.find(image, format, options.pngLevel, size);
+	if(!png.isEmpty()) return png;
+	// Smooth (area-averaging, SIMD-optimized in Qt) resampling to the placed size
+	const QImage scaled = size == image.size() ? image : image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	if(options.pngLevel >= 0) png = PngEncoder::encode(scaled, options.pngLevel);
+	if(png.isEmpty()) { QBuffer buf(&png); buf.open(QIODevice::WriteOnly); scaled.save(&buf, "PNG"); }
+	cache.insert(image, format, options.pngLevel, size, png);
+	return png;
+}
+
+}} // namespace QtDocxTemplate::engine
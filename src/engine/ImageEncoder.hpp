@@ -0,0 +1,41 @@
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QSize>
+#include <vector>
+#include "QtDocxTemplate/Variables.hpp"
+#include "opc/Package.hpp"
+
+namespace QtDocxTemplate { namespace engine {
+
+struct EncodedImages;
+
+// Encoding stage run before DOM mutation: QImage-backed image variables referenced by the template are
+// encoded concurrently, so the replacers only splice drawing runs and add the ready bytes.
+struct ImageEncoder {
+    struct Options {
+        double downscaleFactor{0.0}; // >0: resample to placed size * factor when larger (0 keeps full resolution)
+        int pngLevel{1};             // 0-9: built-in PngEncoder at that level (1 fastest); -1: Qt's PNG plugin
+    };
+    struct Job { QString key; QImage image; QSize size; QByteArray sourceKey; };
+    // Pixel size to encode image placed at widthPx x heightPx
+    static QSize targetSize(const QImage &image, int widthPx, int heightPx, const Options &options);
+    // Identity of image encoded at size (Package media lookup key)
+    static QByteArray sourceKey(const QImage &image, const QSize &size);
+    // One job per distinct image/size among image variables (table cells included) not yet embedded in pkg
+    static std::vector<Job> collect(const ::QtDocxTemplate::Variables &vars, const opc::Package &pkg, const Options &options);
+    // Encode the jobs whose placeholder occurs in text, on the global thread pool
+    static EncodedImages encode(const std::vector<Job> &jobs, const QString &text, const Options &options);
+    // PNG bytes of image at size, served from / stored in EncodedImageCache when it is enabled
+    static QByteArray encodePng(const QImage &image, const QSize &size, const Options &options);
+};
+
+// Output of the encoding stage, consumed by the replacers (which encode anything missing inline)
+struct EncodedImages {
+    ImageEncoder::Options options;
+    QHash<QByteArray, QByteArray> bytes; // sourceKey -> PNG
+};
+
+}} // namespace QtDocxTemplate::engine
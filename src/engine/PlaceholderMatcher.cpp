@@ -0,0 +1,130 @@
+#include "engine/PlaceholderMatcher.hpp"
+#include "QtDocxTemplate/TableVariable.hpp"
+#include <algorithm>
+
+namespace QtDocxTemplate { namespace engine {
+
+PlaceholderMatcher::PlaceholderMatcher(const Variables &vars, const QString &prefix, const QString &suffix)
+	: m_prefix(prefix), m_suffix(suffix) {
+	m_nodes.emplace_back(); // root
+	if(prefix.isEmpty() || suffix.isEmpty()) return; // no delimited tokens to find
+	m_nodes[insert(prefix)].delimiters |= PrefixEnd;
+	m_nodes[insert(suffix)].delimiters |= SuffixEnd;
+	for(const auto &vp : vars.all()) {
+		switch(vp->type()) {
+		case VariableType::Text: {
+			// Text keys may be given bare or already wrapped
+			const QString &key = vp->key();
+			add(key.startsWith(prefix) && key.endsWith(suffix) ? key : prefix + key + suffix, VariableType::Text, vp.get());
+			break;
+		}
+		case VariableType::Image:
+		case VariableType::BulletList:
+			add(vp->key(), vp->type(), vp.get());
+			break;
+		case VariableType::Table: {
+			const auto *tv = static_cast<const TableVariable*>(vp.get());
+			m_tables.push_back(tv);
+			for(const auto &key : tv->placeholderKeys()) add(key, VariableType::Table, tv);
+			break;
+		}
+		}
+	}
+	build();
+}
+
+int32_t PlaceholderMatcher::insert(const QString &pattern) {
+	int32_t n = 0;
+	for(QChar ch : pattern) {
+		const char16_t c = ch.unicode();
+		auto &next = m_nodes[n].next;
+		auto it = std::lower_bound(next.begin(), next.end(), c, [](const std::pair<char16_t, int32_t> &e, char16_t v){ return e.first < v; });
+		if(it != next.end() && it->first == c) { n = it->second; continue; }
+		const int32_t id = static_cast<int32_t>(m_nodes.size());
+		const int32_t depth = m_nodes[n].depth + 1;
+		next.insert(it, {c, id});
+		m_nodes.emplace_back(); // invalidates next
+		m_nodes.back().depth = depth;
+		n = id;
+	}
+	return n;
+}
+
+void PlaceholderMatcher::add(const QString &key, VariableType type, const Variable *variable) {
+	// Keys that prefix(.*?)suffix can never produce are unreachable: one suffix, at the very end
+	const int inner = key.size() - m_prefix.size() - m_suffix.size();
+	if(inner < 0 || !key.startsWith(m_prefix) || !key.endsWith(m_suffix)) return;
+	if(key.indexOf(m_suffix, m_prefix.size()) != key.size() - m_suffix.size() || key.contains(QLatin1Char('\n'))) return;
+	Node &node = m_nodes[insert(key)];
+	if(node.placeholder < 0) {
+		node.placeholder = static_cast<int32_t>(m_placeholders.size());
+		m_placeholders.push_back({key, type, variable});
+		return;
+	}
+	// Same key declared twice: the last variable of a kind wins, and kinds replaced earlier in a fill
+	// (text, image, bullet list, table) take precedence over later ones
+	Placeholder &existing = m_placeholders[static_cast<size_t>(node.placeholder)];
+	if(static_cast<int>(type) <= static_cast<int>(existing.type)) { existing.type = type; existing.variable = variable; }
+}
+
+void PlaceholderMatcher::build() {
+	std::vector<int32_t> queue; queue.reserve(m_nodes.size());
+	for(const auto &e : m_nodes[0].next) queue.push_back(e.second); // depth 1: fail to root
+	for(size_t head = 0; head < queue.size(); ++head) {
+		const int32_t u = queue[head];
+		for(const auto &e : m_nodes[u].next) {
+			const int32_t v = e.second;
+			const int32_t f = step(m_nodes[u].fail, e.first);
+			m_nodes[v].fail = f;
+			m_nodes[v].outputLink = m_nodes[f].isOutput() ? f : m_nodes[f].outputLink;
+			queue.push_back(v);
+		}
+	}
+	for(const auto &ph : m_placeholders) ++m_typeCount[static_cast<int>(ph.type)];
+}
+
+int32_t PlaceholderMatcher::step(int32_t state, char16_t c) const {
+	for(;;) {
+		const auto &next = m_nodes[state].next;
+		auto it = std::lower_bound(next.begin(), next.end(), c, [](const std::pair<char16_t, int32_t> &e, char16_t v){ return e.first < v; });
+		if(it != next.end() && it->first == c) return it->second;
+		if(state == 0) return 0;
+		state = m_nodes[state].fail;
+	}
+}
+
+std::vector<PlaceholderMatcher::Match> PlaceholderMatcher::find(const QString &text) const {
+	std::vector<Match> matches;
+	if(m_placeholders.empty()) return matches;
+	const int pl = m_prefix.size(), sl = m_suffix.size();
+	int open = -1; // start of the token being delimited
+	int from = 0;  // next token starts at or after this offset
+	int32_t state = 0;
+	const QChar *data = text.constData();
+	for(int i = 0; i < text.size(); ++i) {
+		const char16_t c = data[i].unicode();
+		if(c == u'\n') { open = -1; from = i + 1; state = 0; continue; } // '.' does not cross line breaks
+		state = step(state, c);
+		const int end = i + 1;
+		const int32_t first = m_nodes[state].isOutput() ? state : m_nodes[state].outputLink;
+		if(open < 0) {
+			// Leftmost prefix opens a token; later prefixes are plain text until the first suffix
+			for(int32_t n = first; n >= 0; n = m_nodes[n].outputLink) {
+				if((m_nodes[n].delimiters & PrefixEnd) && end - pl >= from) { open = end - pl; break; }
+			}
+			continue;
+		}
+		bool closed = false; const Placeholder *hit = nullptr;
+		for(int32_t n = first; n >= 0; n = m_nodes[n].outputLink) {
+			const Node &node = m_nodes[n];
+			if((node.delimiters & SuffixEnd) && end - sl >= open + pl) closed = true;
+			if(node.placeholder >= 0 && node.depth == end - open) hit = &m_placeholders[static_cast<size_t>(node.placeholder)];
+		}
+		if(!closed) continue;
+		if(hit) matches.push_back({open, end, hit});
+		open = -1; from = end;
+	}
+	return matches;
+}
+
+}} // namespace QtDocxTemplate::engine
@@ -0,0 +1,57 @@
+#pragma once
+#include <QString>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "QtDocxTemplate/Variables.hpp"
+
+namespace QtDocxTemplate {
+class TableVariable;
+namespace engine {
+
+// Placeholder tokenizer built once per fill: an Aho-Corasick automaton over the delimiters and every
+// variable key (text, image, bullet list, table column), so a paragraph is scanned in one linear pass.
+// Tokens are delimited exactly like prefix(.*?)suffix; only tokens equal to a known key are reported.
+class PlaceholderMatcher {
+public:
+    struct Placeholder {
+        QString key;
+        VariableType type;                 // Table: key is a column placeholder of variable
+        const Variable *variable{nullptr};
+    };
+    struct Match {
+        int start{0};
+        int end{0};
+        const Placeholder *placeholder{nullptr};
+    };
+
+    PlaceholderMatcher(const Variables &vars, const QString &prefix, const QString &suffix);
+    bool empty() const { return m_placeholders.empty(); }
+    bool has(VariableType type) const { return m_typeCount[static_cast<int>(type)] > 0; }
+    const std::vector<const TableVariable*> & tables() const { return m_tables; } // declaration order
+    std::vector<Match> find(const QString &text) const; // tokens in text order
+
+private:
+    enum : uint8_t { PrefixEnd = 1, SuffixEnd = 2 };
+    struct Node {
+        std::vector<std::pair<char16_t, int32_t>> next; // sorted by character
+        int32_t fail{0};
+        int32_t outputLink{-1}; // nearest node on the fail chain ending a delimiter or key
+        int32_t depth{0};       // length of the string spelled by this node
+        int32_t placeholder{-1}; // index into m_placeholders if a key ends here
+        uint8_t delimiters{0};   // PrefixEnd / SuffixEnd
+        bool isOutput() const { return delimiters || placeholder >= 0; }
+    };
+    int32_t step(int32_t state, char16_t c) const;
+    int32_t insert(const QString &pattern); // node spelling pattern
+    void add(const QString &key, VariableType type, const Variable *variable);
+    void build(); // failure and output links
+
+    std::vector<Node> m_nodes;
+    std::vector<Placeholder> m_placeholders;
+    std::vector<const TableVariable*> m_tables;
+    int m_typeCount[4]{};
+    QString m_prefix, m_suffix;
+};
+
+}} // namespace QtDocxTemplate::engine
@@ -0,0 +1,114 @@
+#include "engine/PngEncoder.hpp"
+#include <QtEndian>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+
+namespace QtDocxTemplate { namespace engine {
+
+namespace {
+
+void appendChunk(QByteArray &out, const char type[4], const QByteArray &data) {
+	char len[4]; qToBigEndian<quint32>(quint32(data.size()), len);
+	out.append(len, 4);
+	const qsizetype start = out.size();
+	out.append(type, 4);
+	out.append(data);
+	uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(out.constData() + start), uInt(out.size() - start));
+	char crcBytes[4]; qToBigEndian<quint32>(quint32(crc), crcBytes);
+	out.append(crcBytes, 4);
+}
+
+inline uchar paeth(int a, int b, int c) {
+	int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	return uchar(pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+}
+
+// Filter one scanline (bpp bytes per pixel, prev null for the first row) into out[0..len] (out[0] = filter type)
+void filterRow(int type, const uchar *row, const uchar *prev, int len, int bpp, uchar *out) {
+	out[0] = uchar(type);
+	uchar *o = out + 1;
+	for(int i = 0; i < len; ++i) {
+		const int a = i >= bpp ? row[i - bpp] : 0;
+		const int b = prev ? prev[i] : 0;
+		const int c = (prev && i >= bpp) ? prev[i - bpp] : 0;
+		switch(type) {
+		case 0: o[i] = row[i]; break;
+		case 1: o[i] = uchar(row[i] - a); break;
+		case 2: o[i] = uchar(row[i] - b); break;
+		case 3: o[i] = uchar(row[i] - ((a + b) >> 1)); break;
+		default: o[i] = uchar(row[i] - paeth(a, b, c)); break;
+		}
+	}
+}
+
+quint64 filterCost(const uchar *out, int len) {
+	quint64 sum = 0;
+	for(int i = 1; i <= len; ++i) sum += quint64(std::abs(int(qint8(out[i]))));
+	return sum;
+}
+
+} // namespace
+
+QByteArray PngEncoder::encode(const QImage &source, int level) {
+	if(source.isNull()) return {};
+	level = std::clamp(level, 0, 9);
+	QImage image; int colorType; int bpp;
+	if(source.format() == QImage::Format_Grayscale8) { image = source; colorType = 0; bpp = 1; }
+	else if(source.hasAlphaChannel()) { image = source.convertToFormat(QImage::Format_RGBA8888); colorType = 6; bpp = 4; }
+	else { image = source.convertToFormat(QImage::Format_RGB888); colorType = 2; bpp = 3; }
+	const int w = image.width(), h = image.height(), rowLen = w * bpp;
+
+	// Filtered scanlines
+	QByteArray raw(qsizetype(rowLen + 1) * h, Qt::Uninitialized);
+	QByteArray trial(level >= 4 ? 5 * (rowLen + 1) : 0, Qt::Uninitialized);
+	for(int y = 0; y < h; ++y) {
+		const uchar *row = image.constScanLine(y);
+		const uchar *prev = y > 0 ? image.constScanLine(y - 1) : nullptr;
+		uchar *dst = reinterpret_cast<uchar*>(raw.data()) + qsizetype(rowLen + 1) * y;
+		if(level == 0) { filterRow(0, row, prev, rowLen, bpp, dst); continue; }
+		if(level < 4) { filterRow(prev ? 2 : 1, row, prev, rowLen, bpp, dst); continue; }
+		// Minimum sum of absolute differences heuristic (as libpng's adaptive filtering)
+		int best = 0; quint64 bestCost = ~quint64(0);
+		for(int t = 0; t < 5; ++t) {
+			uchar *cand = reinterpret_cast<uchar*>(trial.data()) + t * (rowLen + 1);
+			filterRow(t, row, prev, rowLen, bpp, cand);
+			quint64 cost = filterCost(cand, rowLen);
+			if(cost < bestCost) { bestCost = cost; best = t; }
+		}
+		std::memcpy(dst, trial.constData() + best * (rowLen + 1), size_t(rowLen + 1));
+	}
+
+	// zlib stream for IDAT
+	z_stream zs{};
+	if(deflateInit2(&zs, level, Z_DEFLATED, MAX_WBITS, 8, level > 0 && level < 4 ? Z_RLE : Z_DEFAULT_STRATEGY) != Z_OK) return {};
+	QByteArray idat(qsizetype(deflateBound(&zs, uLong(raw.size()))), Qt::Uninitialized);
+	zs.next_in = reinterpret_cast<Bytef*>(raw.data());
+	zs.avail_in = uInt(raw.size());
+	zs.next_out = reinterpret_cast<Bytef*>(idat.data());
+	zs.avail_out = uInt(idat.size());
+	const bool ok = deflate(&zs, Z_FINISH) == Z_STREAM_END;
+	idat.resize(ok ? qsizetype(zs.total_out) : 0);
+	deflateEnd(&zs);
+	if(!ok) return {};
+
+	QByteArray out("\x89PNG\r\n\x1a\n", 8);
+	QByteArray ihdr(13, '\0');
+	qToBigEndian<quint32>(quint32(w), ihdr.data());
+	qToBigEndian<quint32>(quint32(h), ihdr.data() + 4);
+	ihdr[8] = 8; ihdr[9] = char(colorType); // bit depth, color type; compression/filter/interlace 0
+	appendChunk(out, "IHDR", ihdr);
+	if(image.dotsPerMeterX() > 0 && image.dotsPerMeterY() > 0) {
+		QByteArray phys(9, '\0');
+		qToBigEndian<quint32>(quint32(image.dotsPerMeterX()), phys.data());
+		qToBigEndian<quint32>(quint32(image.dotsPerMeterY()), phys.data() + 4);
+		phys[8] = 1; // unit: metre
+		appendChunk(out, "pHYs", phys);
+	}
+	appendChunk(out, "IDAT", idat);
+	appendChunk(out, "IEND", QByteArray());
+	return out;
+}
+
+}} // namespace QtDocxTemplate::engine
@@ -0,0 +1,15 @@
+#pragma once
+#include <QByteArray>
+#include <QImage>
+
+namespace QtDocxTemplate { namespace engine {
+
+// Minimal PNG writer for generated images (charts, screenshots): 8-bit gray/RGB/RGBA, no interlacing.
+// Compared to Qt's image plugin it skips libpng and trades size for speed through level:
+// 1-3 use the "up" filter (first row "sub") and zlib's run-length strategy, 4-9 pick the best
+// filter per row and run regular deflate at that level; 0 stores uncompressed.
+struct PngEncoder {
+    static QByteArray encode(const QImage &image, int level);
+};
+
+}} // namespace QtDocxTemplate::engine
@@ -7,10 +7,9 @@
 #include "QtDocxTemplate/TableVariable.hpp"
 #include "util/Emu.hpp"
 #include "opc/Package.hpp"
-#include <QRegularExpression>
+#include "opc/Relationships.hpp"
+#include <algorithm>
 #include <unordered_map>
-#include <QBuffer>
-#include <QFileInfo>
 #include <sstream>
 #include <QDebug>
 
@@ -47,81 +46,41 @@ void TableVariable::addColumn(const std::vector<VariablePtr> &column) {
 
 namespace engine {
 
-namespace { QString wrapKey(const QString &k,const QString &pre,const QString &suf){ return pre + k + suf; } }
-
-void Replacers::replaceText(pugi::xml_document &doc,
-							const QString &prefix,
-							const QString &suffix,
-							const ::QtDocxTemplate::Variables &vars) {
-	// Build lookup of wrapped placeholders => replacement
-	std::unordered_map<QString, QString> map; map.reserve(vars.all().size()*2);
-	for(const auto &vp : vars.all()) {
-		if(vp->type() != VariableType::Text) continue;
-		auto *tv = static_cast<TextVariable*>(vp.get());
-		QString key = vp->key();
-		if(key.startsWith(prefix) && key.endsWith(suffix)) {
-			// Stored key already wrapped; accept both wrapped literal and inner form
-			QString inner = key.mid(prefix.size(), key.size()-prefix.size()-suffix.size());
-			map[key] = tv->value();
-			map[wrapKey(inner,prefix,suffix)] = tv->value();
-		} else {
-			map[wrapKey(key,prefix,suffix)] = tv->value();
-		}
-	}
-	if(map.empty()) return;
-
-	pugi::xpath_query pq("//w:p");
-	auto pnodes = pq.evaluate_node_set(doc);
-	for(auto &n : pnodes) {
-		pugi::xml_node p = n.node();
-		RunModel rm; rm.build(p);
-		QString paraText = rm.text();
-		if(paraText.isEmpty()) continue;
-		QRegularExpression re(QRegularExpression::escape(prefix)+"(.*?)"+QRegularExpression::escape(suffix));
-		auto it = re.globalMatch(paraText);
-		struct Match { int s; int e; QString token; };
-		std::vector<Match> matches;
-		while(it.hasNext()) {
-			auto m = it.next();
-			QString token = m.captured(0);
-			if(!map.count(token)) continue; // skip unknown
-			matches.push_back({(int)m.capturedStart(0), (int)m.capturedEnd(0), token});
-		}
-		if(matches.empty()) continue;
-		std::sort(matches.begin(), matches.end(), [](const Match &a,const Match &b){ return a.s > b.s; });
-		for(const auto &mm : matches) {
-			QString replacement = map[mm.token];
-			rm.replaceRange(mm.s, mm.e, [&](pugi::xml_node w_p, pugi::xml_node styleR){
-				auto newRun = RunModel::makeTextRun(w_p, styleR, replacement, true);
-				return std::vector<pugi::xml_node>{ newRun };
-			});
-			rm.build(p); // rebuild after each replacement
-		}
+// Text placeholders among matches, replaced back to front (rm stays current, earlier offsets stay valid);
+// returns true if the paragraph changed
+static bool replaceTextMatches(RunModel &rm, const std::vector<PlaceholderMatcher::Match> &matches) {
+	bool changed = false;
+	for(auto it = matches.rbegin(); it != matches.rend(); ++it) {
+		if(it->placeholder->type != VariableType::Text) continue;
+		const QString &replacement = static_cast<const TextVariable*>(it->placeholder->variable)->value();
+		rm.replaceRange(it->start, it->end, [&](pugi::xml_node w_p, pugi::xml_node styleR){
+			auto newRun = RunModel::makeTextRun(w_p, styleR, replacement, true);
+			return std::vector<pugi::xml_node>{ newRun };
+		});
+		changed = true;
 	}
+	return changed;
 }
 
-// Helper: ensure document relationships part loaded/created
-static pugi::xml_document loadOrCreateDocRels(Package &pkg) {
-	pugi::xml_document rels;
-	auto data = pkg.readPart("word/_rels/document.xml.rels");
-	if(data) {
-		rels.load_buffer(data->constData(), data->size());
-	}
-	if(!rels.child("Relationships")) {
-		auto root = rels.append_child("Relationships");
-		root.append_attribute("xmlns") = "http://schemas.openxmlformats.org/package/2006/relationships";
-	}
-	return rels;
+// Helper: register media part as image relationship of partName; returns the new rId
+static QString addImageRelationship(Package &pkg, const QString &partName, const QString &mediaPath) {
+	return pkg.relationships(partName).add(opc::Relationships::ImageType, mediaPath);
 }
 
-static QString nextImageRelId(const pugi::xml_document &rels) {
-	int maxId = 0;
-	for(auto r : rels.child("Relationships").children("Relationship")) {
-		QString id = r.attribute("Id").value();
-		if(id.startsWith("rId")) {
-			bool ok=false; int num = id.mid(3).toInt(&ok); if(ok && num>maxId) maxId=num; }
-	}
-	return QString("rId%1").arg(maxId+1);
+// Helper: media part for an image variable. Encoded bytes are added verbatim, files are streamed at save;
+// QImages use the bytes from the encoding stage, else are PNG-encoded here, once per image data in pkg.
+static QString embedImage(Package &pkg, const ImageVariable &iv, const EncodedImages &encoded) {
+	if(iv.source() == ImageVariable::Source::Encoded) return pkg.addMedia(iv.encodedData(), iv.format());
+	if(iv.source() == ImageVariable::Source::File) return iv.filePath().isEmpty() ? QString() : pkg.addMediaFile(iv.filePath(), iv.format());
+	const QImage &img = iv.image();
+	if(img.isNull()) return pkg.addMedia(ImageEncoder::encodePng(img, img.size(), encoded.options), "png");
+	const QSize size = ImageEncoder::targetSize(img, iv.widthPx(), iv.heightPx(), encoded.options);
+	const QByteArray key = ImageEncoder::sourceKey(img, size);
+	QString known = pkg.mediaForSourceKey(key); if(!known.isEmpty()) return known;
+	auto pre = encoded.bytes.constFind(key);
+	QString mediaPath = pkg.addMedia(pre != encoded.bytes.constEnd() ? pre.value() : ImageEncoder::encodePng(img, size, encoded.options), "png");
+	pkg.setMediaForSourceKey(key, mediaPath);
+	return mediaPath;
 }
 
 static pugi::xml_node buildDrawingRun(pugi::xml_node w_p, pugi::xml_node styleR, const QString &rId, int wPx, int hPx) {
@@ -148,93 +107,106 @@ static pugi::xml_node buildDrawingRun(pugi::xml_node w_p, pugi::xml_node styleR,
 	return r;
 }
 
-void Replacers::replaceImages(pugi::xml_document &doc, Package &pkg,
-							  const QString &prefix, const QString &suffix,
-							  const ::QtDocxTemplate::Variables &vars) {
-	// Build map of image variables
-	struct Img { QImage img; int w; int h; QString key; };
-	std::unordered_map<QString, Img> imap;
-	for(const auto &v : vars.all()) if(v->type()==VariableType::Image) {
-		auto *iv = static_cast<ImageVariable*>(v.get());
-		QString k = v->key(); imap[k] = {iv->image(), iv->widthPx(), iv->heightPx(), k};
-	}
-	if(imap.empty()) return;
-	pugi::xpath_query pq("//w:p");
-	auto pnodes = pq.evaluate_node_set(doc);
-	for(auto &nn : pnodes) {
-		pugi::xml_node p = nn.node();
-		RunModel rm; rm.build(p); QString paraText = rm.text(); if(paraText.isEmpty()) continue;
-		QRegularExpression re(QRegularExpression::escape(prefix)+"(.*?)"+QRegularExpression::escape(suffix));
-		auto it = re.globalMatch(paraText);
-		struct M { int s; int e; QString tok; };
-		std::vector<M> matches; while(it.hasNext()){ auto m=it.next(); QString token=m.captured(0); if(!imap.count(token)) continue; matches.push_back({(int)m.capturedStart(0), (int)m.capturedEnd(0), token}); }
-		if(matches.empty()) continue; std::sort(matches.begin(), matches.end(), [](auto &a, auto &b){ return a.s > b.s; });
-		for(auto &mm : matches) {
-			auto info = imap[mm.tok];
-			// Add media part
-			QByteArray png; QBuffer buf(&png); buf.open(QIODevice::WriteOnly); info.img.save(&buf, "PNG");
-			QString mediaPath = pkg.addMedia(png, "png");
-			// Update rels
-			auto rels = loadOrCreateDocRels(pkg);
-			QString rId = nextImageRelId(rels);
-			auto relRoot = rels.child("Relationships");
-			auto rel = relRoot.append_child("Relationship");
-			rel.append_attribute("Id") = rId.toUtf8().constData();
-			rel.append_attribute("Type") = "http://schemas.openxmlformats.org/officeDocument/2006/relationships/image";
-			rel.append_attribute("Target") = QString("media/%1").arg(QFileInfo(mediaPath).fileName()).toUtf8().constData();
-			// Persist rels
-			std::stringstream ss; rels.save(ss, "  "); QByteArray relBytes(ss.str().c_str(), ss.str().size());
-			pkg.writePart("word/_rels/document.xml.rels", relBytes);
-			rm.replaceRangeStructural(mm.s, mm.e, [&](pugi::xml_node w_p, pugi::xml_node styleR){ auto r = buildDrawingRun(w_p, styleR, rId, info.w, info.h); return std::vector<pugi::xml_node>{ r }; });
-			rm.build(p);
-		}
+// Image placeholders among matches, replaced back to front; returns true if the paragraph changed
+static bool replaceImageMatches(RunModel &rm, Package &pkg, const QString &partName,
+								const std::vector<PlaceholderMatcher::Match> &matches, const EncodedImages &encoded) {
+	bool changed = false;
+	for(auto it = matches.rbegin(); it != matches.rend(); ++it) {
+		if(it->placeholder->type != VariableType::Image) continue;
+		const auto *info = static_cast<const ImageVariable*>(it->placeholder->variable);
+		// Add (or reuse) media part
+		QString mediaPath = embedImage(pkg, *info, encoded);
+		if(mediaPath.isEmpty()) continue; // unreadable image file: leave placeholder
+		QString rId = addImageRelationship(pkg, partName, mediaPath);
+		rm.replaceRangeStructural(it->start, it->end, [&](pugi::xml_node w_p, pugi::xml_node styleR){ auto r = buildDrawingRun(w_p, styleR, rId, info->widthPx(), info->heightPx()); return std::vector<pugi::xml_node>{ r }; });
+		changed = true;
 	}
+	return changed;
 }
 
 // Forward declaration for numbering helper
 static QString ensureBulletNumbering(opc::Package &pkg);
 
-void Replacers::replaceBulletLists(pugi::xml_document &doc, Package &pkg, const QString &prefix, const QString &suffix, const ::QtDocxTemplate::Variables &vars) {
-	// Map bullet list variables
-	std::unordered_map<QString, const BulletListVariable*> bmap;
-	for(const auto &v : vars.all()) if(v->type()==VariableType::BulletList) bmap[v->key()] = static_cast<const BulletListVariable*>(v.get());
-	if(bmap.empty()) return;
-	pugi::xpath_query pq("//w:p");
-	auto pnodes = pq.evaluate_node_set(doc);
+// Expand the first bullet list placeholder among matches into one paragraph per item, replacing p.
+// numId/numberingPrepared carry the numbering definition across paragraphs of a part.
+static bool expandBulletList(pugi::xml_node p, Package &pkg, const std::vector<PlaceholderMatcher::Match> &matches,
+							 QString &numId, bool &numberingPrepared) {
+	auto mm = std::find_if(matches.begin(), matches.end(), [](const PlaceholderMatcher::Match &m){ return m.placeholder->type == VariableType::BulletList; });
+	if(mm == matches.end()) return false; // only first bullet placeholder processed per paragraph for simplicity
+	// Assume one placeholder per bullet paragraph template
+	auto bl = static_cast<const BulletListVariable*>(mm->placeholder->variable);
+	// Prepare numbering only once if needed
+	if(!numberingPrepared) { numId = ensureBulletNumbering(pkg); numberingPrepared = !numId.isEmpty(); }
+	// Clone paragraph N times before original
+	for(const auto &itemVar : bl->items()) {
+		pugi::xml_node clone = p.parent().insert_copy_before(p, p);
+		// Remove all existing runs in clone
+		std::vector<pugi::xml_node> runsToRemove; for(pugi::xml_node r = clone.child("w:r"); r; r = r.next_sibling("w:r")) runsToRemove.push_back(r);
+		for(auto r : runsToRemove) clone.remove_child(r);
+		if(itemVar->type()==VariableType::Text) {
+			auto *tv = static_cast<const TextVariable*>(itemVar.get());
+			RunModel::makeTextRun(clone, pugi::xml_node(), tv->value(), true);
+		}
+		// Add numbering properties if available
+		if(numberingPrepared) {
+			pugi::xml_node pPr = clone.child("w:pPr"); if(!pPr) pPr = clone.insert_child_before("w:pPr", clone.first_child());
+			pugi::xml_node numPr = pPr.child("w:numPr"); if(!numPr) numPr = pPr.append_child("w:numPr");
+			pugi::xml_node ilvl = numPr.child("w:ilvl"); if(!ilvl) ilvl = numPr.append_child("w:ilvl"); ilvl.append_attribute("w:val") = "0";
+			pugi::xml_node numIdNode = numPr.child("w:numId"); if(!numIdNode) numIdNode = numPr.append_child("w:numId"); numIdNode.append_attribute("w:val") = numId.toUtf8().constData();
+		}
+	}
+	// Remove original template paragraph
+	p.parent().remove_child(p);
+	return true;
+}
+
+Replacers::Result Replacers::fill(const xml::DocumentIndex &index, Package &pkg, const QString &partName,
+					 const PlaceholderMatcher &matcher, const EncodedImages &encoded) {
+	const bool text = matcher.has(VariableType::Text);
+	const bool images = matcher.has(VariableType::Image);
+	const bool bullets = matcher.has(VariableType::BulletList);
 	QString numId; bool numberingPrepared=false;
-	for(auto &nn : pnodes) {
-		pugi::xml_node p = nn.node();
-		RunModel rm; rm.build(p); QString paraText = rm.text(); if(paraText.isEmpty()) continue;
-		QRegularExpression re(QRegularExpression::escape(prefix)+"(.*?)"+QRegularExpression::escape(suffix));
-		auto it = re.globalMatch(paraText); struct M { int s; int e; QString tok; }; std::vector<M> matches; while(it.hasNext()){ auto m=it.next(); QString token=m.captured(0); if(!bmap.count(token)) continue; matches.push_back({(int)m.capturedStart(0), (int)m.capturedEnd(0), token}); }
-		if(matches.empty()) continue; // only first bullet placeholder processed per paragraph for simplicity
-		// Assume one placeholder per bullet paragraph template
-		auto mm = matches.front(); auto bl = bmap[mm.tok];
-		// Clone paragraph N times before original
-		std::vector<pugi::xml_node> newParas;
-		// Prepare numbering only once if needed
-		if(!numberingPrepared) { numId = ensureBulletNumbering(pkg); numberingPrepared = !numId.isEmpty(); }
-		for(const auto &itemVar : bl->items()) {
-			pugi::xml_node clone = p.parent().insert_copy_before(p, p);
-			// Remove all existing runs in clone
-			std::vector<pugi::xml_node> runsToRemove; for(pugi::xml_node r = clone.child("w:r"); r; r = r.next_sibling("w:r")) runsToRemove.push_back(r);
-			for(auto r : runsToRemove) clone.remove_child(r);
-			if(itemVar->type()==VariableType::Text) {
-				auto *tv = static_cast<const TextVariable*>(itemVar.get());
-				RunModel::makeTextRun(clone, pugi::xml_node(), tv->value(), true);
-			}
-			// Add numbering properties if available
-			if(numberingPrepared) {
-				pugi::xml_node pPr = clone.child("w:pPr"); if(!pPr) pPr = clone.insert_child_before("w:pPr", clone.first_child());
-				pugi::xml_node numPr = pPr.child("w:numPr"); if(!numPr) numPr = pPr.append_child("w:numPr");
-				pugi::xml_node ilvl = numPr.child("w:ilvl"); if(!ilvl) ilvl = numPr.append_child("w:ilvl"); ilvl.append_attribute("w:val") = "0";
-				pugi::xml_node numIdNode = numPr.child("w:numId"); if(!numIdNode) numIdNode = numPr.append_child("w:numId"); numIdNode.append_attribute("w:val") = numId.toUtf8().constData();
-			}
-			newParas.push_back(clone);
+	const auto &paragraphs = index.paragraphs();
+	std::vector<char> tableRemoved(index.tables().size(), 0);
+	bool modified = false;
+	for(size_t i = 0; (text || images || bullets) && i < paragraphs.size(); ++i) {
+		pugi::xml_node p = paragraphs[i].node;
+		RunModel rm; rm.build(p); if(rm.text().isEmpty()) continue;
+		auto matches = matcher.find(rm.text());
+		if(matches.empty()) continue;
+		// Same results as separate passes: images and bullet lists see the text after text replacement,
+		// bullet lists the text after image replacement
+		if(text && replaceTextMatches(rm, matches)) {
+			modified = true;
+			if(!images && !bullets) continue;
+			matches = matcher.find(rm.text());
+		}
+		if(images && replaceImageMatches(rm, pkg, partName, matches, encoded)) {
+			modified = true;
+			if(bullets) matches = matcher.find(rm.text());
 		}
-		// Remove original template paragraph
-		p.parent().remove_child(p);
+		// Paragraphs and tables nested in a replaced bullet template went with it
+		if(bullets && expandBulletList(p, pkg, matches, numId, numberingPrepared)) {
+			modified = true;
+			std::fill(tableRemoved.begin() + paragraphs[i].firstTable, tableRemoved.begin() + paragraphs[i].endTable, 1);
+			i = paragraphs[i].endParagraph - 1;
+		}
+	}
+	// Tables last: row expansion embeds its images after those of the paragraphs, as before
+	std::vector<pugi::xml_node> tables; tables.reserve(index.tables().size());
+	for(size_t t = 0; t < index.tables().size(); ++t) if(!tableRemoved[t]) tables.push_back(index.tables()[t]);
+	Result result = replaceTables(tables, pkg, partName, matcher, encoded);
+	result.modified = result.modified || modified;
+	return result;
+}
+
+bool Replacers::hasPlaceholders(const xml::DocumentIndex &index, const PlaceholderMatcher &matcher) {
+	if(matcher.empty()) return false;
+	for(const auto &p : index.paragraphs()) {
+		RunModel rm; rm.build(p.node); // same text the fill pass tokenizes
+		if(!rm.text().isEmpty() && !matcher.find(rm.text()).empty()) return true;
 	}
+	return false;
 }
 
 // Helper to create numbering.xml with single bullet abstract/num if absent; returns numId or empty QString on failure
@@ -283,29 +255,13 @@ static QString ensureBulletNumbering(opc::Package &pkg) {
 }
 
 
-bool Replacers::replaceTables(pugi::xml_document &doc, Package &pkg, const QString &prefix, const QString &suffix, const ::QtDocxTemplate::Variables &vars) {
-	// Collect all TableVariables
-	std::vector<const TableVariable*> tables;
-	tables.reserve(vars.all().size());
-	for(const auto &v : vars.all()) if(v->type()==VariableType::Table) tables.push_back(static_cast<const TableVariable*>(v.get()));
-	if(tables.empty()) return false;
-
-	// Build placeholder -> (tableIdx, columnIdx) map
-	struct ColRef { size_t tableIdx; size_t colIdx; };
-	std::unordered_map<QString, ColRef> placeholderMap;
-	for(size_t ti=0; ti<tables.size(); ++ti) {
-		const auto *tv = tables[ti];
-		for(size_t ci=0; ci<tv->placeholderKeys().size(); ++ci) {
-			placeholderMap[tv->placeholderKeys()[ci]] = {ti, ci};
-		}
-	}
-	if(placeholderMap.empty()) return false;
-    bool anyMismatch = false;
+Replacers::Result Replacers::replaceTables(const std::vector<pugi::xml_node> &tblNodes, Package &pkg, const QString &partName, const PlaceholderMatcher &matcher, const EncodedImages &encoded) {
+	if(!matcher.has(VariableType::Table)) return {};
+	const auto &tables = matcher.tables();
+    Result result;
 
 	// Iterate tables in document
-	pugi::xpath_query tq("//w:tbl"); auto tblNodes = tq.evaluate_node_set(doc);
-	for(auto &tn : tblNodes) {
-		pugi::xml_node tblNode = tn.node();
+	for(pugi::xml_node tblNode : tblNodes) {
 		bool expanded = false;
 		// Examine each row to find a template row (containing one or more known placeholders)
 		for(pugi::xml_node tr = tblNode.child("w:tr"); tr; tr = tr.next_sibling("w:tr")) {
@@ -315,12 +271,9 @@ bool Replacers::replaceTables(pugi::xml_document &doc, Package &pkg, const QStri
 			for(pugi::xml_node tc = tr.child("w:tc"); tc; tc = tc.next_sibling("w:tc")) {
 				for(pugi::xml_node p = tc.child("w:p"); p; p = p.next_sibling("w:p")) {
 					RunModel rm; rm.build(p); QString txt = rm.text(); if(txt.isEmpty()) continue;
-					QRegularExpression re(QRegularExpression::escape(prefix)+"(.*?)"+QRegularExpression::escape(suffix));
-					auto it = re.globalMatch(txt);
-					while(it.hasNext()) {
-						auto m = it.next(); QString token = m.captured(0);
-						if(placeholderMap.count(token)) {
-							cellTokens.push_back({tc, p, token});
+					for(const auto &m : matcher.find(txt)) {
+						if(m.placeholder->type == VariableType::Table) {
+							cellTokens.push_back({tc, p, m.placeholder->key});
 							break; // one token per cell is typical
 						}
 					}
@@ -340,7 +293,8 @@ bool Replacers::replaceTables(pugi::xml_document &doc, Package &pkg, const QStri
 			}
 			if(!matched) continue; // row doesn't fully represent a declared table variable
 
-			bool lenMismatch=false; size_t rowCount = matched->validatedRowCount(lenMismatch); if(lenMismatch) anyMismatch = true;
+			bool lenMismatch=false; size_t rowCount = matched->validatedRowCount(lenMismatch); if(lenMismatch) result.mismatch = true;
+			result.modified = true;
 			if(rowCount==0) { tblNode.remove_child(tr); expanded=true; break; }
 			if(lenMismatch) qWarning("TableVariable: column length mismatch; truncating to minimum length %zu", rowCount);
 
@@ -361,35 +315,25 @@ bool Replacers::replaceTables(pugi::xml_document &doc, Package &pkg, const QStri
 					// Find placeholder token in first paragraph
 					for(pugi::xml_node p = tc.child("w:p"); p; p = p.next_sibling("w:p")) {
 						RunModel rm; rm.build(p); QString txt = rm.text(); if(txt.isEmpty()) continue;
-						for(const auto &kv : colIndexByToken) {
-							const QString &token = kv.first; size_t colIdx = kv.second;
-							int pos = txt.indexOf(token); if(pos<0) continue;
-							int endPos = pos + token.size();
+						for(const auto &m : matcher.find(txt)) {
+							auto ci = colIndexByToken.find(m.placeholder->key); if(ci == colIndexByToken.end()) continue;
+							size_t colIdx = ci->second;
+							int pos = m.start;
+							int endPos = m.end;
 							// Retrieve variable for this row/column
 							const auto &col = matched->columns()[colIdx]; if(r >= col.size()) break;
 							auto cellVar = col[r];
 							if(cellVar->type()==VariableType::Text) {
 								auto *tv = static_cast<TextVariable*>(cellVar.get());
 								rm.replaceRange(pos, endPos, [&](pugi::xml_node w_p, pugi::xml_node styleR){ auto run = RunModel::makeTextRun(w_p, styleR, tv->value(), true); return std::vector<pugi::xml_node>{ run }; });
-								rm.build(p);
 							} else if(cellVar->type()==VariableType::Image) {
 								auto *iv = static_cast<ImageVariable*>(cellVar.get());
-								// Encode image to PNG and add media part
-								QByteArray png; QBuffer buf(&png); buf.open(QIODevice::WriteOnly); iv->image().save(&buf, "PNG");
-								QString mediaPath = pkg.addMedia(png, "png");
-								// Update relationships
-								auto rels = loadOrCreateDocRels(pkg);
-								QString rId = nextImageRelId(rels);
-								auto relRoot = rels.child("Relationships");
-								auto rel = relRoot.append_child("Relationship");
-								rel.append_attribute("Id") = rId.toUtf8().constData();
-								rel.append_attribute("Type") = "http://schemas.openxmlformats.org/officeDocument/2006/relationships/image";
-								rel.append_attribute("Target") = QString("media/%1").arg(QFileInfo(mediaPath).fileName()).toUtf8().constData();
-								std::stringstream ss; rels.save(ss, "  "); QByteArray relBytes(ss.str().c_str(), ss.str().size());
-								pkg.writePart("word/_rels/document.xml.rels", relBytes);
+								// Encode image to PNG and add media part (reused for repeated images)
+								QString mediaPath = embedImage(pkg, *iv, encoded);
+								if(mediaPath.isEmpty()) break;
+								QString rId = addImageRelationship(pkg, partName, mediaPath);
 								// Structural replacement with drawing run (similar to paragraph images)
 								rm.replaceRangeStructural(pos, endPos, [&](pugi::xml_node w_p, pugi::xml_node styleR){ auto run = buildDrawingRun(w_p, styleR, rId, iv->widthPx(), iv->heightPx()); return std::vector<pugi::xml_node>{ run }; });
-								rm.build(p);
 							}
 							break; // one placeholder per cell
 						}
@@ -406,7 +350,7 @@ bool Replacers::replaceTables(pugi::xml_document &doc, Package &pkg, const QStri
 			// (Optional – suppressed for brevity)
 		}
 	}
-	    return anyMismatch;
+	    return result;
 	}
 
 }} // namespace QtDocxTemplate::engine
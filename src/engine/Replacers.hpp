@@ -3,25 +3,32 @@
 #include <pugixml.hpp>
 #include "QtDocxTemplate/Variables.hpp"
 #include "opc/Package.hpp"
+#include "engine/ImageEncoder.hpp"
+#include "engine/PlaceholderMatcher.hpp"
+#include "xml/DocumentIndex.hpp"
 
 namespace QtDocxTemplate { namespace engine {
 
-// Variable replacement engine for text, image, bullet list, and table processing
+// Variable replacement engine for text, image, bullet list, and table processing.
+// Works on a paragraph/table index built once per part and a matcher built once per fill over all keys.
 struct Replacers {
-    static void replaceText(pugi::xml_document &doc,
-                            const QString &prefix,
-                            const QString &suffix,
-                            const ::QtDocxTemplate::Variables &vars);
-    static void replaceImages(pugi::xml_document &doc, opc::Package &pkg,
-                              const QString &prefix, const QString &suffix,
-                              const ::QtDocxTemplate::Variables &vars);
-    static void replaceBulletLists(pugi::xml_document &doc, opc::Package &pkg,
-                                   const QString &prefix, const QString &suffix,
-                                   const ::QtDocxTemplate::Variables &vars);
-    // Returns true if any table experienced a column length mismatch (truncated)
-    static bool replaceTables(pugi::xml_document &doc, opc::Package &pkg,
-                              const QString &prefix, const QString &suffix,
-                              const ::QtDocxTemplate::Variables &vars);
+    struct Result {
+        bool mismatch{false}; // a table column length mismatch truncated the expansion
+        bool modified{false}; // the part was changed (must be serialized again)
+    };
+    // Fill one part in a single paragraph traversal: text, image and bullet list placeholders of each
+    // paragraph are tokenized once and replaced in that order, then table template rows are expanded.
+    // partName: package part holding the indexed document; new image relationships go to its relationships part.
+    // encoded: PNG bytes prepared by ImageEncoder; images missing there are encoded inline.
+    static Result fill(const xml::DocumentIndex &index, opc::Package &pkg, const QString &partName,
+                       const PlaceholderMatcher &matcher,
+                       const EncodedImages &encoded = {});
+    // True if any paragraph of the indexed part holds a placeholder known to matcher, i.e. fill may change it
+    static bool hasPlaceholders(const xml::DocumentIndex &index, const PlaceholderMatcher &matcher);
+    // Expand template rows of tblNodes (all still in the document)
+    static Result replaceTables(const std::vector<pugi::xml_node> &tblNodes, opc::Package &pkg, const QString &partName,
+                                const PlaceholderMatcher &matcher,
+                                const EncodedImages &encoded = {});
 };
 
 }} // namespace QtDocxTemplate::engine
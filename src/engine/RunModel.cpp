@@ -24,6 +24,34 @@ void RunModel::build(pugi::xml_node w_p) {
 	}
 }
 
+std::pair<int, int> RunModel::runSpanRange(int firstIdx, int lastIdx) const {
+	int from = firstIdx, to = lastIdx + 1;
+	while(from > 0 && m_spans[from-1].r == m_spans[firstIdx].r) --from;
+	while(to < (int)m_spans.size() && m_spans[to].r == m_spans[lastIdx].r) ++to;
+	return {from, to};
+}
+
+void RunModel::respan(int from, int to, const std::vector<pugi::xml_node> &runs) {
+	const int start = m_spans[from].start;
+	const int oldLen = m_spans[to-1].start + m_spans[to-1].len - start;
+	std::vector<Span> spans; QString text;
+	for(auto r : runs) {
+		if(!r) continue;
+		for(pugi::xml_node child = r.first_child(); child; child = child.next_sibling()) {
+			if(!isWT(child)) continue;
+			QString t = QString::fromUtf8(child.text().get());
+			Span span; span.t = child; span.r = r; span.start = start + text.size(); span.len = t.size();
+			spans.push_back(span);
+			text += t;
+		}
+	}
+	const int delta = text.size() - oldLen;
+	for(int i = to; i < (int)m_spans.size(); ++i) m_spans[i].start += delta;
+	m_spans.erase(m_spans.begin() + from, m_spans.begin() + to);
+	m_spans.insert(m_spans.begin() + from, spans.begin(), spans.end());
+	m_text.replace(start, oldLen, text);
+}
+
 pugi::xml_node RunModel::styleSourceRun(int start, int /*end*/) const {
 	for(const auto &s : m_spans) {
 		if(start < s.start + s.len && start >= s.start) return s.r; // first overlapped
@@ -71,32 +99,38 @@ void RunModel::replaceRangeStructural(int start, int end,
 	if(single) {
 		QString full = QString::fromUtf8(firstSpan.t.text().get()); QString left = full.left(firstOff); QString right = full.mid(lastOff);
 		pugi::xml_node anchor = firstSpan.r; // we'll remove
+		std::vector<pugi::xml_node> inserted; // runs taking the anchor's place, in order
 		// insert left segment before anchor if any
 		if(!left.isEmpty()) {
 			pugi::xml_node l = RunModel::makeTextRun(w_p, styleR, left, true);
-			w_p.insert_copy_before(l, anchor); w_p.remove_child(l);
+			inserted.push_back(w_p.insert_copy_before(l, anchor)); w_p.remove_child(l);
 		}
 		// insert new runs
 		auto newRuns = makeRuns(w_p, styleR);
-		for(auto r : newRuns) { if(!r) continue; w_p.insert_copy_before(r, anchor); w_p.remove_child(r); }
+		for(auto r : newRuns) { if(!r) continue; inserted.push_back(w_p.insert_copy_before(r, anchor)); w_p.remove_child(r); }
 		// insert right segment
 		if(!right.isEmpty()) {
 			pugi::xml_node rSeg = RunModel::makeTextRun(w_p, styleR, right, true);
-			w_p.insert_copy_before(rSeg, anchor); w_p.remove_child(rSeg);
+			inserted.push_back(w_p.insert_copy_before(rSeg, anchor)); w_p.remove_child(rSeg);
 		}
+		auto range = runSpanRange(firstIdx, lastIdx);
 		if(anchor.parent()) anchor.parent().remove_child(anchor);
+		respan(range.first, range.second, inserted);
 		return;
 	}
 	// multi span: collapse to single anchor after building left+new+right then remove covered runs
 	QString firstText = QString::fromUtf8(firstSpan.t.text().get()); QString lastText = QString::fromUtf8(lastSpan.t.text().get());
 	QString leftKeep = firstText.left(firstOff); QString rightKeep = lastText.mid(lastOff);
 	pugi::xml_node anchor = firstSpan.r;
-	if(!leftKeep.isEmpty()) { auto l=RunModel::makeTextRun(w_p, styleR, leftKeep, true); w_p.insert_copy_before(l, anchor); w_p.remove_child(l);} 
-	auto newRuns = makeRuns(w_p, styleR); for(auto r : newRuns){ if(r){ w_p.insert_copy_before(r, anchor); w_p.remove_child(r);} }
-	if(!rightKeep.isEmpty()) { auto rr=RunModel::makeTextRun(w_p, styleR, rightKeep, true); w_p.insert_copy_before(rr, anchor); w_p.remove_child(rr);} 
+	std::vector<pugi::xml_node> inserted;
+	if(!leftKeep.isEmpty()) { auto l=RunModel::makeTextRun(w_p, styleR, leftKeep, true); inserted.push_back(w_p.insert_copy_before(l, anchor)); w_p.remove_child(l);} 
+	auto newRuns = makeRuns(w_p, styleR); for(auto r : newRuns){ if(r){ inserted.push_back(w_p.insert_copy_before(r, anchor)); w_p.remove_child(r);} }
+	if(!rightKeep.isEmpty()) { auto rr=RunModel::makeTextRun(w_p, styleR, rightKeep, true); inserted.push_back(w_p.insert_copy_before(rr, anchor)); w_p.remove_child(rr);} 
 	// remove covered runs
+	auto range = runSpanRange(firstIdx, lastIdx);
 	std::vector<pugi::xml_node> toRemove; for(pugi::xml_node r=firstSpan.r; r; r=r.next_sibling()){ toRemove.push_back(r); if(r==lastSpan.r) break; }
 	for(auto r : toRemove) if(r.parent()) r.parent().remove_child(r);
+	respan(range.first, range.second, inserted);
 }
 
 void RunModel::replaceRange(int start, int end,
@@ -141,6 +175,8 @@ void RunModel::replaceRange(int start, int end,
 		// Overwrite original run text with aggregate and ensure xml:space="preserve"
 		firstSpan.t.text().set(replacementAggregate.toUtf8().constData());
 		if(!firstSpan.t.attribute("xml:space")) firstSpan.t.append_attribute("xml:space") = "preserve"; else firstSpan.t.attribute("xml:space").set_value("preserve");
+		auto range = runSpanRange(firstIdx, lastIdx);
+		respan(range.first, range.second, { firstSpan.r });
 		return;
 	}
 	// Multi-span
@@ -159,6 +195,7 @@ void RunModel::replaceRange(int start, int end,
 	// Remove all covered runs and replace with a single styled run
 	std::vector<pugi::xml_node> toRemove; for(pugi::xml_node r = firstSpan.r; r; r = r.next_sibling()) { toRemove.push_back(r); if(r==lastSpan.r) break; }
 	pugi::xml_node styleSource = styleR;
+	auto range = runSpanRange(firstIdx, lastIdx);
 	for(auto r : toRemove) { if(r==firstSpan.r) continue; if(r.parent()) r.parent().remove_child(r); }
 	// Reuse first run's node as container
 	if(firstSpan.t) {
@@ -166,6 +203,7 @@ void RunModel::replaceRange(int start, int end,
 		if(!firstSpan.t.attribute("xml:space")) firstSpan.t.append_attribute("xml:space") = "preserve"; else firstSpan.t.attribute("xml:space").set_value("preserve");
 		// Ensure style of first run only (remove other style children if they exist? Already removed other runs)
 	}
+	respan(range.first, range.second, { firstSpan.r });
 	return;
 }
 
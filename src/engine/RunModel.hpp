@@ -2,6 +2,7 @@
 #include <QString>
 #include <vector>
 #include <functional>
+#include <utility>
 #include <pugixml.hpp>
 
 namespace QtDocxTemplate { namespace engine {
@@ -15,7 +16,7 @@ public:
         int len{0};
     };
 
-    void build(pugi::xml_node w_p); // build mapping for a paragraph
+    void build(pugi::xml_node w_p); // build mapping for a paragraph; replacements keep it up to date
     const QString & text() const { return m_text; }
     pugi::xml_node styleSourceRun(int start, int end) const; // first overlapped run
 
@@ -29,6 +30,12 @@ public:
     static pugi::xml_node makeTextRun(pugi::xml_node w_p, pugi::xml_node styleR, const QString &text, bool preserveSpace=true);
 
 private:
+    // Spans of every run touched by a replacement of spans [firstIdx, lastIdx]: [from, to)
+    std::pair<int, int> runSpanRange(int firstIdx, int lastIdx) const;
+    // Replace spans [from, to) by the w:t of runs (now in their place) and shift later offsets,
+    // so back-to-front replacements need no rebuild
+    void respan(int from, int to, const std::vector<pugi::xml_node> &runs);
+
     QString m_text;
     std::vector<Span> m_spans;
 };
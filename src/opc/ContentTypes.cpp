@@ -0,0 +1,57 @@
+#include "opc/ContentTypes.hpp"
+#include <cstring>
+
+namespace QtDocxTemplate { namespace opc {
+
+ContentTypes::ContentTypes(const ContentTypes &other)
+	: m_defaults(other.m_defaults), m_overrides(other.m_overrides), m_modified(other.m_modified) {
+	m_xml.doc().reset(other.m_xml.doc());
+}
+
+void ContentTypes::load(const QByteArray &data) {
+	m_defaults.clear(); m_overrides.clear(); m_modified = false;
+	pugi::xml_document &doc = m_xml.doc();
+	if(data.isEmpty() || !m_xml.load(data) || !doc.child("Types")) {
+		doc.reset();
+		auto decl = doc.append_child(pugi::node_declaration);
+		decl.append_attribute("version") = "1.0";
+		decl.append_attribute("encoding") = "UTF-8";
+		auto root = doc.append_child("Types");
+		root.append_attribute("xmlns") = "http://schemas.openxmlformats.org/package/2006/content-types";
+		addDefault(QStringLiteral("rels"), QStringLiteral("application/vnd.openxmlformats-package.relationships+xml"));
+		addDefault(QStringLiteral("xml"), QStringLiteral("application/xml"));
+		return;
+	}
+	for(auto n : doc.child("Types").children()) {
+		if(std::strcmp(n.name(), "Default") == 0) {
+			m_defaults.insert(QString::fromUtf8(n.attribute("Extension").value()).toLower(), QString::fromUtf8(n.attribute("ContentType").value()));
+		} else if(std::strcmp(n.name(), "Override") == 0) {
+			QString part = QString::fromUtf8(n.attribute("PartName").value());
+			if(part.startsWith('/')) part.remove(0,1);
+			m_overrides.insert(part, QString::fromUtf8(n.attribute("ContentType").value()));
+		}
+	}
+}
+
+QString ContentTypes::of(const QString &partName) const {
+	auto it = m_overrides.constFind(partName);
+	if(it != m_overrides.constEnd()) return it.value();
+	int dot = partName.lastIndexOf('.');
+	return dot < 0 ? QString() : m_defaults.value(partName.mid(dot + 1).toLower());
+}
+
+void ContentTypes::addDefault(const QString &extIn, const QString &mime) {
+	QString ext = extIn.toLower();
+	if(m_defaults.contains(ext)) return;
+	m_defaults.insert(ext, mime);
+	auto def = m_xml.doc().child("Types").append_child("Default");
+	def.append_attribute("Extension") = ext.toUtf8().constData();
+	def.append_attribute("ContentType") = mime.toUtf8().constData();
+	m_modified = true;
+}
+
+QByteArray ContentTypes::save() const {
+	return m_xml.save();
+}
+
+}} // namespace QtDocxTemplate::opc
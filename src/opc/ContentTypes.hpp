@@ -0,0 +1,33 @@
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include "xml/XmlPart.hpp"
+
+namespace QtDocxTemplate { namespace opc {
+
+// Parsed [Content_Types].xml. Lookups and additions are hash operations; the part is
+// serialized once when the package is saved.
+class ContentTypes {
+public:
+    ContentTypes() = default;
+    ContentTypes(const ContentTypes &other);
+    ContentTypes & operator=(const ContentTypes &) = delete;
+
+    void load(const QByteArray &data); // empty/invalid data starts the minimal part (rels + xml defaults)
+    // Content type of a part (name without leading '/'): Override first, then Default by extension
+    QString of(const QString &partName) const;
+    bool hasDefault(const QString &ext) const { return m_defaults.contains(ext.toLower()); }
+    void addDefault(const QString &ext, const QString &mime); // no-op if ext already has a Default
+    QByteArray save() const;
+    bool modified() const { return m_modified; }
+    void setModified(bool modified) { m_modified = modified; }
+
+private:
+    xml::XmlPart m_xml;
+    QHash<QString,QString> m_defaults;  // lower-case extension -> content type
+    QHash<QString,QString> m_overrides; // part name without leading '/' -> content type
+    bool m_modified{false};
+};
+
+}} // namespace QtDocxTemplate::opc
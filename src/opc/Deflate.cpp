@@ -0,0 +1,156 @@
+#include "opc/Deflate.hpp"
+
+#include <QtConcurrent/QtConcurrentMap>
+#include <algorithm>
+#include <zlib.h>
+#ifdef QTDOCTEMPLATE_USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+namespace QtDocxTemplate { namespace opc {
+
+namespace {
+
+#ifdef QTDOCTEMPLATE_USE_LIBDEFLATE
+constexpr bool kChunked = false; // libdeflate always terminates the stream: one job per part
+#else
+constexpr bool kChunked = true;
+constexpr int kWindowSize = 32 * 1024;
+#endif
+
+struct Segment {
+	const QByteArray *input{nullptr};
+	qsizetype offset{0};
+	qsizetype len{0};
+	bool last{true};
+	int level{Z_DEFAULT_COMPRESSION};
+	QByteArray out;
+	quint32 crc{0};
+	bool ok{false};
+};
+
+#ifdef QTDOCTEMPLATE_USE_LIBDEFLATE
+// One compressor per worker thread, reallocated only when the level changes
+struct ThreadCompressor {
+	int level{-1};
+	libdeflate_compressor *c{nullptr};
+	~ThreadCompressor() { if(c) libdeflate_free_compressor(c); }
+	libdeflate_compressor *get(int lvl) {
+		if(lvl < 0) lvl = 6;
+		if(!c || level != lvl) {
+			if(c) libdeflate_free_compressor(c);
+			c = libdeflate_alloc_compressor(lvl);
+			level = lvl;
+		}
+		return c;
+	}
+};
+
+void deflateSegment(Segment &seg) {
+	thread_local ThreadCompressor compressor;
+	const char *begin = seg.input->constData() + seg.offset;
+	seg.crc = libdeflate_crc32(0, begin, (size_t)seg.len);
+	libdeflate_compressor *c = compressor.get(seg.level);
+	if(!c) return;
+	seg.out.resize((qsizetype)libdeflate_deflate_compress_bound(c, (size_t)seg.len));
+	size_t n = libdeflate_deflate_compress(c, begin, (size_t)seg.len, seg.out.data(), (size_t)seg.out.size());
+	seg.ok = n > 0;
+	seg.out.resize((qsizetype)n);
+}
+#else
+// Deflate one segment of a raw stream. Non-final segments end on a byte boundary (Z_SYNC_FLUSH) so that
+// independently produced segments can simply be concatenated.
+void deflateSegment(Segment &seg) {
+	const char *begin = seg.input->constData() + seg.offset;
+	seg.crc = (quint32)crc32(0L, reinterpret_cast<const Bytef*>(begin), (uInt)seg.len);
+	z_stream zs{};
+	if(deflateInit2(&zs, seg.level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+	if(seg.offset > 0) {
+		qsizetype dictLen = std::min<qsizetype>(seg.offset, kWindowSize);
+		deflateSetDictionary(&zs, reinterpret_cast<const Bytef*>(begin - dictLen), (uInt)dictLen);
+	}
+	seg.out.resize((qsizetype)deflateBound(&zs, (uLong)seg.len) + 16);
+	zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(begin));
+	zs.avail_in = (uInt)seg.len;
+	zs.next_out = reinterpret_cast<Bytef*>(seg.out.data());
+	zs.avail_out = (uInt)seg.out.size();
+	int rc = deflate(&zs, seg.last ? Z_FINISH : Z_SYNC_FLUSH);
+	seg.ok = seg.last ? rc == Z_STREAM_END : (rc == Z_OK && zs.avail_in == 0);
+	seg.out.resize(seg.ok ? (qsizetype)zs.total_out : 0);
+	deflateEnd(&zs);
+}
+#endif
+
+} // namespace
+
+DeflateResult Deflate::compress(const QByteArray &input, int level) {
+	return compressAll({input}, {level}).front();
+}
+
+bool Deflate::decompress(const QByteArray &raw, QByteArray &out) {
+#ifdef QTDOCTEMPLATE_USE_LIBDEFLATE
+	thread_local struct Decompressor {
+		libdeflate_decompressor *d{libdeflate_alloc_decompressor()};
+		~Decompressor() { if(d) libdeflate_free_decompressor(d); }
+	} decompressor;
+	if(!decompressor.d) return false;
+	return libdeflate_deflate_decompress(decompressor.d, raw.constData(), (size_t)raw.size(),
+										 out.data(), (size_t)out.size(), nullptr) == LIBDEFLATE_SUCCESS;
+#else
+	z_stream zs{};
+	if(inflateInit2(&zs, -MAX_WBITS) != Z_OK) return false;
+	zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(raw.constData()));
+	zs.avail_in = (uInt)raw.size();
+	zs.next_out = reinterpret_cast<Bytef*>(out.data());
+	zs.avail_out = (uInt)out.size();
+	int rc = inflate(&zs, Z_FINISH);
+	bool ok = rc == Z_STREAM_END && zs.total_out == (uLong)out.size();
+	inflateEnd(&zs);
+	return ok;
+#endif
+}
+
+quint32 Deflate::crc32(const QByteArray &data) {
+#ifdef QTDOCTEMPLATE_USE_LIBDEFLATE
+	return libdeflate_crc32(0, data.constData(), (size_t)data.size());
+#else
+	return (quint32)::crc32(0L, reinterpret_cast<const Bytef*>(data.constData()), (uInt)data.size());
+#endif
+}
+
+std::vector<DeflateResult> Deflate::compressAll(const std::vector<QByteArray> &inputs, const std::vector<int> &levels) {
+	std::vector<Segment> segments;
+	std::vector<size_t> firstSegment; firstSegment.reserve(inputs.size());
+	for(size_t i = 0; i < inputs.size(); ++i) {
+		const QByteArray &in = inputs[i];
+		const int level = i < levels.size() ? levels[i] : Z_DEFAULT_COMPRESSION;
+		firstSegment.push_back(segments.size());
+		qsizetype len = in.size();
+		qsizetype step = kChunked && len > 2 * ChunkSize ? ChunkSize : std::max<qsizetype>(len, 1);
+		for(qsizetype off = 0; off < len || off == 0; off += step) {
+			Segment seg; seg.input = &in; seg.offset = off; seg.len = std::min(step, len - off);
+			seg.last = off + step >= len; seg.level = level;
+			segments.push_back(std::move(seg));
+		}
+	}
+	QtConcurrent::blockedMap(segments, deflateSegment);
+
+	std::vector<DeflateResult> results(inputs.size());
+	for(size_t i = 0; i < inputs.size(); ++i) {
+		size_t end = i + 1 < inputs.size() ? firstSegment[i + 1] : segments.size();
+		DeflateResult &res = results[i];
+		res.size = (quint64)inputs[i].size();
+		qsizetype total = 0; bool ok = true;
+		for(size_t s = firstSegment[i]; s < end; ++s) { total += segments[s].out.size(); ok = ok && segments[s].ok; }
+		if(!ok) continue; // data left empty: caller reports the failure
+		res.data.reserve(total);
+		for(size_t s = firstSegment[i]; s < end; ++s) {
+			const Segment &seg = segments[s];
+			res.data.append(seg.out);
+			res.crc = s == firstSegment[i] ? seg.crc : (quint32)crc32_combine(res.crc, seg.crc, (z_off_t)seg.len);
+		}
+	}
+	return results;
+}
+
+}} // namespace QtDocxTemplate::opc
@@ -0,0 +1,29 @@
+#pragma once
+#include <QByteArray>
+#include <vector>
+
+namespace QtDocxTemplate { namespace opc {
+
+// Raw DEFLATE output for one part, ready to be stored as a ZIP entry without recompression
+struct DeflateResult {
+    QByteArray data;   // raw deflate stream (no zlib/gzip wrapper); empty if compression failed
+    quint32 crc{0};    // CRC-32 of the uncompressed bytes
+    quint64 size{0};   // uncompressed size
+};
+
+// Whole-buffer part (de)compression. Backed by zlib (or zlib-ng in compat mode), or by libdeflate when built
+// with QDT_USE_LIBDEFLATE. Parts are independent jobs; with zlib, parts larger than 2*ChunkSize are split into
+// ChunkSize segments that are deflated concurrently (previous 32 KiB primed as dictionary, segments ended with
+// a sync flush) and concatenated into one valid stream, CRCs combined. libdeflate only emits complete streams,
+// so there parallelism is per part.
+struct Deflate {
+    static constexpr qsizetype ChunkSize = 256 * 1024;
+    static DeflateResult compress(const QByteArray &input, int level);
+    // Inflate a raw deflate stream into out, which must already be sized to the expected uncompressed size
+    static bool decompress(const QByteArray &raw, QByteArray &out);
+    static quint32 crc32(const QByteArray &data);
+    // Compress all inputs on the global thread pool (levels[i] applies to inputs[i]); results in input order
+    static std::vector<DeflateResult> compressAll(const std::vector<QByteArray> &inputs, const std::vector<int> &levels);
+};
+
+}} // namespace QtDocxTemplate::opc
@@ -1,11 +1,22 @@
 ﻿#include "opc/Package.hpp"
+#include "opc/Deflate.hpp"
+#include "opc/Relationships.hpp"
+#include "opc/ContentTypes.hpp"
 
 #include <QFile>
+#include <QTemporaryFile>
+#include <QIODevice>
 #include <QFileInfo>
 #include <QDir>
 #include <QRegularExpression>
+#include <QCryptographicHash>
 #include <QDebug>
+#include <algorithm>
 #include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <zlib.h>
 
 #ifdef QTDOCTEMPLATE_USE_LIBZIP
 #include <zip.h>
@@ -18,7 +29,6 @@
 #include <mz_strm_buf.h>
 #include <zip.h> // compatibility layer
 #include <unzip.h>
-#include <zlib.h>
 #endif
 
 namespace QtDocxTemplate { namespace opc {
@@ -28,164 +38,758 @@ void Package::normalizePath(QString &p) const {
 	if(p.startsWith("./")) p.remove(0,2);
 }
 
-bool Package::open(const QString &path) {
+Package::PartKind Package::classify(const QString &name) {
+	if(name.endsWith(QLatin1String(".rels"))) return PartKind::Relationships;
+	if(name == QLatin1String("[Content_Types].xml")) return PartKind::ContentTypes;
+	if(name.startsWith(QLatin1String("word/media/"))) return PartKind::Media;
+	if(name == QLatin1String("word/document.xml")) return PartKind::MainDocument;
+	if(name == QLatin1String("word/numbering.xml")) return PartKind::Numbering;
+	if(name.endsWith(QLatin1String(".xml"))) {
+		if(name.startsWith(QLatin1String("word/header"))) return PartKind::Header;
+		if(name.startsWith(QLatin1String("word/footer"))) return PartKind::Footer;
+	}
+	return PartKind::Other;
+}
+
+QHash<QString,Package::Part>::iterator Package::findPart(const QString &name) const {
+	auto it = m_parts.find(name);
+	if(it != m_parts.end() || (!name.contains('\\') && !name.startsWith(QLatin1String("./")))) return it;
+	QString key = name; normalizePath(key);
+	return m_parts.find(key);
+}
+
+void Package::insertPart(const QString &key, Part part) {
+	auto it = m_parts.find(key);
+	if(it != m_parts.end()) {
+		part.kind = it.value().kind;
+		it.value() = std::move(part);
+		return;
+	}
+	part.kind = classify(key);
+	m_partsByKind[static_cast<int>(part.kind)].append(key);
+	m_parts.insert(key, std::move(part));
+}
+
+void Package::clearParts() {
 	m_parts.clear();
+	m_relationships.clear();
+	m_contentTypes.reset();
+	m_nextMediaIndex.clear();
+	m_mediaByDigest.clear();
+	m_mediaBySourceKey.clear();
+	m_mediaByFile.clear();
+	for(auto &names : m_partsByKind) names.clear();
+}
+
+struct Package::Archive {
+	std::unique_ptr<QFile> file; // mapped template file (declared first: unmapped last)
+	QByteArray bytes; // in-memory or mapped archive bytes (must outlive the reader)
+	std::mutex mutex; // serializes reader access; the archive is shared by cloned packages
+#ifdef QTDOCTEMPLATE_USE_LIBZIP
+	zip_t *zip{nullptr};
+	~Archive() { if(zip) zip_discard(zip); }
+#else
+	unzFile zip{nullptr};
+	~Archive() { if(zip) unzClose(zip); }
+#endif
+};
+
+Package::Package() = default;
+Package::~Package() = default;
+
+bool Package::open(const QString &path) {
+	clearParts();
+	m_archive.reset();
+	auto archive = std::make_shared<Archive>();
+	// Prefer a read-only mapping: the ZIP reader then works on page-cache pages shared by all
+	// readers of the same template instead of read() copies into private buffers.
+	archive->file = std::make_unique<QFile>(path);
+	if(archive->file->open(QIODevice::ReadOnly) && archive->file->size() > 0) {
+		if(uchar *mapped = archive->file->map(0, archive->file->size())) {
+			archive->bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), archive->file->size());
+			return openArchive(std::move(archive));
+		}
+	}
+	archive->file.reset();
 #ifdef QTDOCTEMPLATE_USE_LIBZIP
 	int err = 0;
-	zip_t *archive = zip_open(path.toUtf8().constData(), ZIP_RDONLY, &err);
-	if(!archive) {
+	archive->zip = zip_open(path.toUtf8().constData(), ZIP_RDONLY, &err);
+	if(!archive->zip) {
 		qWarning() << "libzip: cannot open" << path << "err" << err;
 		return false;
 	}
-	zip_int64_t num = zip_get_num_entries(archive, 0);
+#else
+	archive->zip = unzOpen(path.toUtf8().constData());
+	if(!archive->zip) return false;
+#endif
+	m_archive = std::move(archive);
+	return readDirectory();
+}
+
+bool Package::openData(const QByteArray &data) {
+	clearParts();
+	m_archive.reset();
+	auto archive = std::make_shared<Archive>();
+	archive->bytes = data;
+	return openArchive(std::move(archive));
+}
+
+bool Package::openArchive(std::shared_ptr<Archive> archive) {
+#ifdef QTDOCTEMPLATE_USE_LIBZIP
+	zip_error_t ze; zip_error_init(&ze);
+	zip_source_t *src = zip_source_buffer_create(archive->bytes.constData(), archive->bytes.size(), 0, &ze);
+	if(src) {
+		archive->zip = zip_open_from_source(src, ZIP_RDONLY, &ze);
+		if(!archive->zip) zip_source_free(src);
+	}
+	if(!archive->zip) {
+		qWarning() << "libzip: cannot open buffer:" << zip_error_strerror(&ze);
+		zip_error_fini(&ze);
+		return false;
+	}
+	zip_error_fini(&ze);
+#else
+	void *stream = mz_stream_mem_create();
+	mz_stream_mem_set_buffer(stream, const_cast<char*>(archive->bytes.constData()), archive->bytes.size());
+	mz_stream_open(stream, nullptr, MZ_OPEN_MODE_READ);
+	archive->zip = unzOpen_MZ(stream); // unzClose releases the stream
+	if(!archive->zip) {
+		mz_stream_mem_delete(&stream);
+		return false;
+	}
+#endif
+	m_archive = std::move(archive);
+	return readDirectory();
+}
+
+bool Package::readDirectory() {
+#ifdef QTDOCTEMPLATE_USE_LIBZIP
+	zip_int64_t num = zip_get_num_entries(m_archive->zip, 0);
 	for(zip_uint64_t i=0;i<(zip_uint64_t)num;++i) {
 		struct zip_stat st; zip_stat_init(&st);
-		if(zip_stat_index(archive, i, 0, &st)==0) {
-			if(st.name && st.size >= 0) {
-				zip_file_t *zf = zip_fopen_index(archive, i, 0);
-				if(!zf) continue;
-				QByteArray data; data.resize(static_cast<int>(st.size));
-				zip_int64_t rd = zip_fread(zf, data.data(), st.size);
-				zip_fclose(zf);
-				if(rd == (zip_int64_t)st.size) {
-					QString name = QString::fromUtf8(st.name);
-					normalizePath(name);
-					m_parts.insert(name, data);
-				}
-			}
+		if(zip_stat_index(m_archive->zip, i, 0, &st)==0 && st.name) {
+			QString name = QString::fromUtf8(st.name);
+			normalizePath(name);
+			Part part; part.sourceEntry = (qint64)i; part.size = st.size;
+			part.compressedSize = st.comp_size; part.crc = st.crc; part.method = st.comp_method;
+			insertPart(name, part);
 		}
 	}
-	zip_close(archive);
-	return true;
 #else
-	unzFile uf = unzOpen(path.toUtf8().constData());
-	if(!uf) return false;
-	if(unzGoToFirstFile(uf) != UNZ_OK) { unzClose(uf); return false; }
+	if(unzGoToFirstFile(m_archive->zip) != UNZ_OK) return false;
 	do {
 		char filename[512];
 		unz_file_info64 info{};
-		if(unzGetCurrentFileInfo64(uf, &info, filename, sizeof(filename), nullptr, 0, nullptr, 0) != UNZ_OK) break;
-		if(unzOpenCurrentFile(uf) != UNZ_OK) break;
-		QByteArray data; data.resize((int)info.uncompressed_size);
-		int rd = unzReadCurrentFile(uf, data.data(), data.size());
-		unzCloseCurrentFile(uf);
-		if(rd == data.size()) {
-			QString name = QString::fromUtf8(filename);
-			normalizePath(name);
-			m_parts.insert(name, data);
-		}
-	} while(unzGoToNextFile(uf) == UNZ_OK);
-	unzClose(uf);
+		if(unzGetCurrentFileInfo64(m_archive->zip, &info, filename, sizeof(filename), nullptr, 0, nullptr, 0) != UNZ_OK) break;
+		QString name = QString::fromUtf8(filename);
+		normalizePath(name);
+		Part part; part.sourceEntry = unzGetOffset64(m_archive->zip); part.size = info.uncompressed_size;
+		part.compressedSize = info.compressed_size; part.crc = (quint32)info.crc; part.method = (int)info.compression_method;
+		insertPart(name, part);
+	} while(unzGoToNextFile(m_archive->zip) == UNZ_OK);
+#endif
 	return true;
+}
+
+std::shared_ptr<Package> Package::clone() const {
+	auto copy = std::make_shared<Package>();
+	copy->m_parts = m_parts; // QByteArray buffers are implicitly shared until a clone rewrites them
+	copy->m_partsByKind = m_partsByKind;
+	copy->m_nextMediaIndex = m_nextMediaIndex;
+	copy->m_mediaByDigest = m_mediaByDigest;
+	copy->m_mediaBySourceKey = m_mediaBySourceKey;
+	copy->m_mediaByFile = m_mediaByFile;
+	// Pending model edits become plain parts of the copy; it parses its own models on demand.
+	// An unmodified content-types model is shared until one side adds to it.
+	for(auto it = m_relationships.cbegin(); it != m_relationships.cend(); ++it) {
+		if(it.value()->modified()) copy->writePart(it.key(), it.value()->save());
+	}
+	if(m_contentTypes && m_contentTypes->modified()) copy->writePart(QStringLiteral("[Content_Types].xml"), m_contentTypes->save());
+	else copy->m_contentTypes = m_contentTypes;
+	copy->m_archive = m_archive;
+	copy->m_compressionPolicy = m_compressionPolicy;
+	return copy;
+}
+
+void Package::preloadXmlParts() const {
+	for(auto it = m_parts.begin(); it != m_parts.end(); ++it) {
+		if(it.key().endsWith(QLatin1String(".xml")) || it.key().endsWith(QLatin1String(".rels"))) loadPart(it.value());
+	}
+	contentTypes(); // parsed once here, shared by clones
+}
+
+qint64 Package::memoryFootprint() const {
+	qint64 total = m_archive ? m_archive->bytes.size() : 0;
+	for(const auto &part : m_parts) total += part.data.size();
+	return total;
+}
+
+bool Package::readEntry(const Part &part, bool raw, QByteArray &out) const {
+	if(part.sourceEntry < 0 || !m_archive) return false;
+	out.resize(static_cast<int>(raw ? part.compressedSize : part.size));
+	std::lock_guard<std::mutex> lock(m_archive->mutex);
+#ifdef QTDOCTEMPLATE_USE_LIBZIP
+	zip_file_t *zf = zip_fopen_index(m_archive->zip, (zip_uint64_t)part.sourceEntry, raw ? ZIP_FL_COMPRESSED : 0);
+	if(!zf) return false;
+	zip_int64_t rd = zip_fread(zf, out.data(), (zip_uint64_t)out.size());
+	zip_fclose(zf);
+	return rd == (zip_int64_t)out.size();
+#else
+	if(unzSetOffset64(m_archive->zip, part.sourceEntry) != UNZ_OK) return false;
+	int method = 0, level = 0;
+	if(unzOpenCurrentFile2(m_archive->zip, &method, &level, raw ? 1 : 0) != UNZ_OK) return false;
+	int rd = unzReadCurrentFile(m_archive->zip, out.data(), out.size());
+	unzCloseCurrentFile(m_archive->zip);
+	return rd == out.size();
 #endif
 }
 
+bool Package::loadPart(Part &part) const {
+	if(part.loaded) return true;
+	if(!part.sourceFile.isEmpty()) {
+		// File-backed media are normally streamed at save; only explicit reads bring them into memory
+		QFile file(part.sourceFile);
+		if(!file.open(QIODevice::ReadOnly)) return false;
+		part.data = file.readAll();
+		part.loaded = true;
+		return true;
+	}
+	// Deflated entries: read the raw stream and inflate it in one call with the Deflate codec
+	// (libdeflate when enabled); other methods are left to the ZIP library.
+	QByteArray data;
+	if(part.method == Z_DEFLATED) {
+		QByteArray raw;
+		if(!readEntry(part, true, raw)) return false;
+		data.resize(static_cast<int>(part.size));
+		if(!Deflate::decompress(raw, data) || Deflate::crc32(data) != part.crc) return false;
+	} else if(!readEntry(part, false, data)) {
+		return false;
+	}
+	part.data = data;
+	part.loaded = true;
+	return true;
+}
+
+namespace {
+
+#ifdef QTDOCTEMPLATE_USE_LIBZIP
+struct PrecompressedBuffer {
+	DeflateResult res;
+	zip_uint16_t method{ZIP_CM_DEFLATE};
+	zip_uint64_t offset{0};
+	zip_error_t error;
+};
+
+// zip_source callback serving already compressed bytes; the stat reports method/CRC so libzip stores them as-is.
+zip_int64_t precompressedCallback(void *userdata, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
+	auto *pb = static_cast<PrecompressedBuffer*>(userdata);
+	switch(cmd) {
+	case ZIP_SOURCE_OPEN: pb->offset = 0; return 0;
+	case ZIP_SOURCE_READ: {
+		zip_uint64_t n = std::min<zip_uint64_t>(len, (zip_uint64_t)pb->res.data.size() - pb->offset);
+		std::memcpy(data, pb->res.data.constData() + pb->offset, n);
+		pb->offset += n;
+		return (zip_int64_t)n;
+	}
+	case ZIP_SOURCE_CLOSE: return 0;
+	case ZIP_SOURCE_STAT: {
+		auto *st = static_cast<zip_stat_t*>(data);
+		zip_stat_init(st);
+		st->valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC;
+		st->size = pb->res.size; st->comp_size = (zip_uint64_t)pb->res.data.size();
+		st->comp_method = pb->method; st->crc = pb->res.crc;
+		return sizeof(zip_stat_t);
+	}
+	case ZIP_SOURCE_ERROR: return zip_error_to_data(&pb->error, data, len);
+	case ZIP_SOURCE_FREE: zip_error_fini(&pb->error); delete pb; return 0;
+	case ZIP_SOURCE_SUPPORTS:
+		return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT,
+											  ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SUPPORTS, -1);
+	default:
+		zip_error_set(&pb->error, ZIP_ER_OPNOTSUPP, 0);
+		return -1;
+	}
+}
+
+zip_source_t *precompressedSource(zip_t *dst, DeflateResult &&res, zip_uint16_t method = ZIP_CM_DEFLATE) {
+	auto *pb = new PrecompressedBuffer;
+	pb->res = std::move(res);
+	pb->method = method;
+	zip_error_init(&pb->error);
+	zip_source_t *src = zip_source_function(dst, precompressedCallback, pb);
+	if(!src) { zip_error_fini(&pb->error); delete pb; }
+	return src;
+}
+
+// Untouched source entry streamed into the output still compressed: chunks are read from the shared
+// source archive under its mutex at zip_close time, never buffered whole.
+struct RawEntry {
+	zip_t *zip{nullptr};
+	std::mutex *mutex{nullptr};
+	zip_uint64_t index{0};
+	zip_uint64_t size{0};
+	zip_uint64_t compressedSize{0};
+	zip_uint32_t crc{0};
+	zip_uint16_t method{ZIP_CM_DEFLATE};
+	zip_file_t *file{nullptr};
+	zip_error_t error;
+};
+
+zip_int64_t rawEntryCallback(void *userdata, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
+	auto *re = static_cast<RawEntry*>(userdata);
+	switch(cmd) {
+	case ZIP_SOURCE_OPEN: {
+		std::lock_guard<std::mutex> lock(*re->mutex);
+		re->file = zip_fopen_index(re->zip, re->index, ZIP_FL_COMPRESSED);
+		if(!re->file) { zip_error_set(&re->error, ZIP_ER_READ, 0); return -1; }
+		return 0;
+	}
+	case ZIP_SOURCE_READ: {
+		std::lock_guard<std::mutex> lock(*re->mutex);
+		zip_int64_t n = zip_fread(re->file, data, len);
+		if(n < 0) zip_error_set(&re->error, ZIP_ER_READ, 0);
+		return n;
+	}
+	case ZIP_SOURCE_CLOSE: {
+		std::lock_guard<std::mutex> lock(*re->mutex);
+		if(re->file) zip_fclose(re->file);
+		re->file = nullptr;
+		return 0;
+	}
+	case ZIP_SOURCE_STAT: {
+		auto *st = static_cast<zip_stat_t*>(data);
+		zip_stat_init(st);
+		st->valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC;
+		st->size = re->size; st->comp_size = re->compressedSize;
+		st->comp_method = re->method; st->crc = re->crc;
+		return sizeof(zip_stat_t);
+	}
+	case ZIP_SOURCE_ERROR: return zip_error_to_data(&re->error, data, len);
+	case ZIP_SOURCE_FREE:
+		if(re->file) { std::lock_guard<std::mutex> lock(*re->mutex); zip_fclose(re->file); }
+		zip_error_fini(&re->error); delete re; return 0;
+	case ZIP_SOURCE_SUPPORTS:
+		return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT,
+											  ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SUPPORTS, -1);
+	default:
+		zip_error_set(&re->error, ZIP_ER_OPNOTSUPP, 0);
+		return -1;
+	}
+}
+
+zip_source_t *rawEntrySource(zip_t *dst, RawEntry *re) {
+	zip_error_init(&re->error);
+	zip_source_t *src = zip_source_function(dst, rawEntryCallback, re);
+	if(!src) { zip_error_fini(&re->error); delete re; }
+	return src;
+}
+#else
+// Store already compressed bytes as a raw entry with their precomputed CRC and size.
+bool writePrecompressedEntry(zipFile dst, const QByteArray &nameUtf8, const DeflateResult &res, int method = Z_DEFLATED) {
+	if(res.data.isEmpty() && res.size > 0) return false;
+	zip_fileinfo zi{};
+	if(zipOpenNewFileInZip2(dst, nameUtf8.constData(), &zi,
+							nullptr,0,nullptr,0,nullptr,
+							method, Z_DEFAULT_COMPRESSION, 1) != ZIP_OK) return false;
+	bool ok = zipWriteInFileInZip(dst, res.data.constData(), (uint32_t)res.data.size()) == ZIP_OK;
+	zipCloseFileInZipRaw64(dst, res.size, res.crc);
+	return ok;
+}
+
+// Copy a source entry's compressed bytes into a new raw entry in fixed-size chunks (caller holds the source lock)
+bool copyRawEntry(unzFile src, qint64 sourceEntry, zipFile dst, const QByteArray &nameUtf8, quint64 size, quint32 crc, int method) {
+	if(unzSetOffset64(src, sourceEntry) != UNZ_OK) return false;
+	int srcMethod = 0, srcLevel = 0;
+	if(unzOpenCurrentFile2(src, &srcMethod, &srcLevel, 1) != UNZ_OK) return false;
+	zip_fileinfo zi{};
+	if(zipOpenNewFileInZip2(dst, nameUtf8.constData(), &zi,
+							nullptr,0,nullptr,0,nullptr,
+							method, Z_DEFAULT_COMPRESSION, 1) != ZIP_OK) { unzCloseCurrentFile(src); return false; }
+	QByteArray chunk(64 * 1024, Qt::Uninitialized);
+	bool ok = true; int n = 0;
+	while(ok && (n = unzReadCurrentFile(src, chunk.data(), chunk.size())) > 0) ok = zipWriteInFileInZip(dst, chunk.constData(), (uint32_t)n) == ZIP_OK;
+	unzCloseCurrentFile(src);
+	zipCloseFileInZipRaw64(dst, size, crc);
+	return ok && n == 0;
+}
+
+bool writeStoredEntry(zipFile dst, const QByteArray &nameUtf8, const QByteArray &data) {
+	zip_fileinfo zi{};
+	if(zipOpenNewFileInZip(dst, nameUtf8.constData(), &zi,
+						   nullptr,0,nullptr,0,nullptr,
+						   0 /* stored */, 0) != ZIP_OK) return false;
+	bool ok = zipWriteInFileInZip(dst, data.constData(), (uint32_t)data.size()) == ZIP_OK;
+	zipCloseFileInZip(dst);
+	return ok;
+}
+
+// Stream a file into a new entry in fixed-size chunks (level 0 = stored)
+bool writeFileEntry(zipFile dst, const QByteArray &nameUtf8, const QString &path, int level) {
+	QFile file(path);
+	if(!file.open(QIODevice::ReadOnly)) return false;
+	zip_fileinfo zi{};
+	if(zipOpenNewFileInZip(dst, nameUtf8.constData(), &zi,
+						   nullptr,0,nullptr,0,nullptr,
+						   level > 0 ? Z_DEFLATED : 0, level) != ZIP_OK) return false;
+	QByteArray chunk(64 * 1024, Qt::Uninitialized);
+	bool ok = true; qint64 n = 0;
+	while(ok && (n = file.read(chunk.data(), chunk.size())) > 0) ok = zipWriteInFileInZip(dst, chunk.constData(), (uint32_t)n) == ZIP_OK;
+	zipCloseFileInZip(dst);
+	return ok && n == 0;
+}
+
+#endif
+} // namespace
+
 bool Package::saveAs(const QString &path) const {
 #ifdef QTDOCTEMPLATE_USE_LIBZIP
+	// libzip writes to a temporary file and renames it over path in zip_close, so saving over the
+	// template (still read for raw copies) is safe
 	int errp = 0;
 	zip_t *archive = zip_open(path.toUtf8().constData(), ZIP_TRUNCATE | ZIP_CREATE, &errp);
 	if(!archive) {
 		qWarning() << "libzip: cannot create" << path << "err" << errp;
 		return false;
 	}
-	for(auto it = m_parts.constBegin(); it != m_parts.constEnd(); ++it) {
-		QByteArray nameUtf8 = it.key().toUtf8();
-		zip_source_t *src = zip_source_buffer(archive, it.value().constData(), it.value().size(), 0);
-		if(!src) { qWarning() << "libzip: source_buffer failed for" << it.key(); continue; }
-		if(zip_file_add(archive, nameUtf8.constData(), src, ZIP_FL_OVERWRITE | ZIP_FL_ENC_UTF_8) < 0) {
-			qWarning() << "libzip: file_add failed for" << it.key();
-			zip_source_free(src);
-		}
-	}
+	if(!writeEntries(archive)) { zip_discard(archive); return false; }
 	if(zip_close(archive) != 0) {
 		qWarning() << "libzip: close failed";
+		zip_discard(archive);
 		return false;
 	}
 	return true;
 #else
-	zipFile zf = zipOpen(path.toUtf8().constData(), APPEND_STATUS_CREATE);
-	if(!zf) return false;
-	for(auto it = m_parts.constBegin(); it != m_parts.constEnd(); ++it) {
-		QByteArray nameUtf8 = it.key().toUtf8();
-		zip_fileinfo zi{};
-		if(zipOpenNewFileInZip(zf, nameUtf8.constData(), &zi,
-								nullptr,0,nullptr,0,nullptr,
-								Z_DEFLATED, Z_DEFAULT_COMPRESSION) != ZIP_OK) {
-			qWarning() << "minizip: open new file failed for" << it.key();
+	// zipOpen would truncate path at once while untouched entries are still read lazily from the source
+	// archive, which may be this very file: stream into a temporary file next to it and rename on success.
+	QTemporaryFile tmp(QFileInfo(path).absoluteDir().filePath(QStringLiteral(".qtdocxtemplate-XXXXXX.tmp")));
+	if(!tmp.open()) {
+		qWarning() << "minizip: cannot create temporary file for" << path;
+		return false;
+	}
+	const QString tmpPath = tmp.fileName();
+	tmp.close(); // keeps the (auto-removed) file; minizip reopens it by name
+	zipFile zf = zipOpen(tmpPath.toUtf8().constData(), APPEND_STATUS_CREATE);
+	if(!zf) {
+		qWarning() << "minizip: cannot create" << tmpPath;
+		return false;
+	}
+	bool ok = writeEntries(zf);
+	ok = zipClose(zf, nullptr) == ZIP_OK && ok;
+	if(!ok) return false;
+	// The old file may still be mapped by the source archive; unlinking it leaves that mapping valid
+	if(QFile::exists(path) && !QFile::remove(path)) {
+		qWarning() << "minizip: cannot replace" << path;
+		return false;
+	}
+	if(!QFile::rename(tmpPath, path)) {
+		qWarning() << "minizip: cannot rename" << tmpPath << "to" << path;
+		return false;
+	}
+	tmp.setAutoRemove(false);
+	return true;
+#endif
+}
+
+std::optional<QByteArray> Package::saveToData() const {
+#ifdef QTDOCTEMPLATE_USE_LIBZIP
+	zip_error_t ze; zip_error_init(&ze);
+	zip_source_t *buffer = zip_source_buffer_create(nullptr, 0, 0, &ze);
+	if(!buffer) { zip_error_fini(&ze); return std::nullopt; }
+	zip_t *archive = zip_open_from_source(buffer, ZIP_TRUNCATE, &ze);
+	if(!archive) {
+		qWarning() << "libzip: cannot create buffer archive:" << zip_error_strerror(&ze);
+		zip_source_free(buffer); zip_error_fini(&ze);
+		return std::nullopt;
+	}
+	zip_error_fini(&ze);
+	zip_source_keep(buffer); // keep the written bytes alive after zip_close
+	if(!writeEntries(archive)) {
+		zip_discard(archive); zip_source_free(buffer);
+		return std::nullopt;
+	}
+	if(zip_close(archive) != 0) {
+		qWarning() << "libzip: close failed";
+		zip_discard(archive); zip_source_free(buffer);
+		return std::nullopt;
+	}
+	QByteArray out;
+	if(zip_source_open(buffer) == 0) {
+		zip_source_seek(buffer, 0, SEEK_END);
+		zip_int64_t size = zip_source_tell(buffer);
+		zip_source_seek(buffer, 0, SEEK_SET);
+		out.resize(static_cast<int>(size));
+		zip_int64_t rd = zip_source_read(buffer, out.data(), (zip_uint64_t)size);
+		zip_source_close(buffer);
+		if(rd != size) out.clear();
+	}
+	zip_source_free(buffer);
+	if(out.isEmpty()) return std::nullopt;
+	return out;
+#else
+	void *stream = mz_stream_mem_create();
+	mz_stream_mem_set_grow_size(stream, 128 * 1024);
+	mz_stream_open(stream, nullptr, MZ_OPEN_MODE_CREATE);
+	zipFile zf = zipOpen_MZ(stream, APPEND_STATUS_CREATE, nullptr);
+	if(!zf) { mz_stream_mem_delete(&stream); return std::nullopt; }
+	// zipClose_MZ finalizes the central directory but keeps the memory stream; zipClose then releases both
+	bool ok = writeEntries(zf);
+	ok = zipClose_MZ(zf, nullptr) == ZIP_OK && ok;
+	QByteArray out;
+	if(ok) {
+		const void *buf = nullptr; int32_t len = 0;
+		mz_stream_mem_get_buffer(stream, &buf);
+		mz_stream_mem_get_buffer_length(stream, &len);
+		out = QByteArray(static_cast<const char*>(buf), len);
+	}
+	zipClose(zf, nullptr);
+	if(!ok) return std::nullopt;
+	return out;
+#endif
+}
+
+bool Package::saveTo(QIODevice *device) const {
+	if(!device) return false;
+	if(!device->isOpen() && !device->open(QIODevice::WriteOnly)) return false;
+	auto data = saveToData();
+	if(!data) return false;
+	return device->write(*data) == data->size();
+}
+
+bool Package::writeEntries(void *writer) const {
+	// Deflate all rewritten parts up front on the thread pool (large parts in parallel chunks), then emit
+	// entries in order: precompressed ones as raw deflate data, stored ones verbatim, untouched ones
+	// copied raw from the source, file-backed media streamed from disk by the ZIP library.
+	// Stops at the first part that cannot be written: a package missing parts is not a valid save.
+	flushModels();
+	enum class Mode { Raw, Deflated, Stored, File };
+	struct Pending { QString name; const Part *part; Mode mode; int job; int level{0}; };
+	const ContentTypes &types = contentTypes();
+	std::vector<Pending> pending; pending.reserve(m_parts.size());
+	std::vector<QByteArray> inputs; std::vector<int> levels;
+	for(auto it = m_parts.begin(); it != m_parts.end(); ++it) {
+		if(it.value().untouched() && m_archive) { pending.push_back({it.key(), &it.value(), Mode::Raw, -1}); continue; }
+		auto setting = m_compressionPolicy.settingFor(it.key(), types.of(it.key()));
+		if(!it.value().sourceFile.isEmpty() && !it.value().loaded) {
+			int level = setting.method == CompressionPolicy::Method::Store ? 0 : std::max(setting.level, 1);
+			pending.push_back({it.key(), &it.value(), Mode::File, -1, level});
 			continue;
 		}
-		if(zipWriteInFileInZip(zf, it.value().constData(), it.value().size()) != ZIP_OK) {
-			qWarning() << "minizip: write failed for" << it.key();
+		if(!loadPart(it.value())) { qWarning() << "Package: cannot read part" << it.key(); return false; }
+		if(setting.method == CompressionPolicy::Method::Store) { pending.push_back({it.key(), &it.value(), Mode::Stored, -1}); continue; }
+		pending.push_back({it.key(), &it.value(), Mode::Deflated, (int)inputs.size()});
+		inputs.push_back(it.value().data);
+		levels.push_back(setting.level);
+	}
+	std::vector<DeflateResult> compressed = Deflate::compressAll(inputs, levels);
+#ifdef QTDOCTEMPLATE_USE_LIBZIP
+	zip_t *archive = static_cast<zip_t*>(writer);
+	for(const auto &pe : pending) {
+		QByteArray nameUtf8 = pe.name.toUtf8();
+		zip_source_t *src = nullptr;
+		if(pe.mode == Mode::Raw) {
+			// Copy original compressed bytes + CRC straight from the source archive (no inflate/deflate)
+			auto *re = new RawEntry;
+			re->zip = m_archive->zip; re->mutex = &m_archive->mutex; re->index = (zip_uint64_t)pe.part->sourceEntry;
+			re->size = pe.part->size; re->compressedSize = pe.part->compressedSize;
+			re->crc = pe.part->crc; re->method = (zip_uint16_t)pe.part->method;
+			src = rawEntrySource(archive, re);
+		} else if(pe.mode == Mode::Stored) {
+			src = zip_source_buffer(archive, pe.part->data.constData(), pe.part->data.size(), 0);
+		} else if(pe.mode == Mode::File) {
+			src = zip_source_file(archive, QFile::encodeName(pe.part->sourceFile).constData(), 0, 0); // read at zip_close
+		} else if(!compressed[pe.job].data.isEmpty()) {
+			src = precompressedSource(archive, std::move(compressed[pe.job]));
+		}
+		if(!src) { qWarning() << "libzip: cannot create source for" << pe.name; return false; }
+		zip_int64_t idx = zip_file_add(archive, nameUtf8.constData(), src, ZIP_FL_OVERWRITE | ZIP_FL_ENC_UTF_8);
+		if(idx < 0) {
+			qWarning() << "libzip: file_add failed for" << pe.name;
+			zip_source_free(src);
+			return false;
+		} else if(pe.mode == Mode::Stored || (pe.mode == Mode::Raw && pe.part->method == ZIP_CM_STORE)) {
+			zip_set_file_compression(archive, (zip_uint64_t)idx, ZIP_CM_STORE, 0);
+		} else if(pe.mode == Mode::File) {
+			zip_set_file_compression(archive, (zip_uint64_t)idx, pe.level > 0 ? ZIP_CM_DEFLATE : ZIP_CM_STORE, (zip_uint32_t)pe.level);
 		}
-		zipCloseFileInZip(zf);
 	}
-	zipClose(zf, nullptr);
-	return true;
+#else
+	zipFile zf = static_cast<zipFile>(writer);
+	for(const auto &pe : pending) {
+		QByteArray nameUtf8 = pe.name.toUtf8();
+		bool ok = false;
+		switch(pe.mode) {
+		case Mode::Raw: {
+			std::lock_guard<std::mutex> lock(m_archive->mutex);
+			ok = copyRawEntry(m_archive->zip, pe.part->sourceEntry, zf, nameUtf8, pe.part->size, pe.part->crc, pe.part->method);
+			break;
+		}
+		case Mode::Stored: ok = writeStoredEntry(zf, nameUtf8, pe.part->data); break;
+		case Mode::Deflated: ok = writePrecompressedEntry(zf, nameUtf8, compressed[pe.job]); break;
+		case Mode::File: ok = writeFileEntry(zf, nameUtf8, pe.part->sourceFile, pe.level); break;
+		}
+		if(!ok) { qWarning() << "minizip: write failed for" << pe.name; return false; }
+	}
 #endif
+	return true;
+}
+
+Relationships & Package::relationships(const QString &sourcePart) {
+	QString relsName = Relationships::partNameFor(sourcePart);
+	auto it = m_relationships.find(relsName);
+	if(it != m_relationships.end()) return *it.value();
+	auto rels = std::make_shared<Relationships>(sourcePart);
+	rels->load(readPart(relsName).value_or(QByteArray()));
+	return *m_relationships.insert(relsName, std::move(rels)).value();
+}
+
+const ContentTypes & Package::contentTypes() const {
+	if(!m_contentTypes) {
+		auto ct = std::make_shared<ContentTypes>();
+		ct->load(readPart(QStringLiteral("[Content_Types].xml")).value_or(QByteArray()));
+		m_contentTypes = std::move(ct);
+	}
+	return *m_contentTypes;
+}
+
+ContentTypes & Package::mutableContentTypes() {
+	contentTypes();
+	if(m_contentTypes.use_count() > 1) m_contentTypes = std::make_shared<ContentTypes>(*m_contentTypes); // shared with clones
+	return *m_contentTypes;
+}
+
+void Package::flushModels() const {
+	for(auto it = m_relationships.cbegin(); it != m_relationships.cend(); ++it) {
+		if(!it.value()->modified()) continue;
+		const_cast<Package*>(this)->writePart(it.key(), it.value()->save());
+		it.value()->setModified(false);
+	}
+	if(m_contentTypes && m_contentTypes->modified()) {
+		// modified models are never shared (clones get a copy of the part instead)
+		const_cast<Package*>(this)->writePart(QStringLiteral("[Content_Types].xml"), m_contentTypes->save());
+		m_contentTypes->setModified(false);
+	}
 }
 
 std::optional<QByteArray> Package::readPart(const QString &name) const {
-	QString key = name; const_cast<Package*>(this)->normalizePath(key);
-	auto it = m_parts.find(key);
+	auto it = findPart(name);
+	if(it == m_parts.end()) return std::nullopt;
+	if(!loadPart(it.value())) {
+		qWarning() << "Package: cannot inflate part" << it.key();
+		return std::nullopt;
+	}
+	return it.value().data;
+}
+
+std::optional<QByteArray> Package::releasePart(const QString &name) {
+	auto it = findPart(name);
 	if(it == m_parts.end()) return std::nullopt;
-	return it.value();
+	if(!loadPart(it.value())) {
+		qWarning() << "Package: cannot inflate part" << it.key();
+		return std::nullopt;
+	}
+	QByteArray data = it.value().data;
+	if(it.value().untouched() && m_archive) {
+		// Saved by raw copy and re-inflated on demand: no need to keep the inflated bytes
+		it.value().data = QByteArray();
+		it.value().loaded = false;
+	}
+	return data;
 }
 
 void Package::writePart(const QString &name, const QByteArray &data) {
+	Part part; part.data = data; part.size = (quint64)data.size(); part.loaded = true;
+	auto it = findPart(name);
+	if(it != m_parts.end()) { insertPart(it.key(), std::move(part)); return; }
 	QString key = name; normalizePath(key);
-	m_parts.insert(key, data);
-}
-
-int Package::nextImageIndex(const QString &ext) const {
-	QRegularExpression re(QStringLiteral(R"(word/media/image(\d+)\.)") );
-	int maxIdx = 0;
-	for(const QString &k : m_parts.keys()) {
-		if(k.startsWith("word/media/image") && k.endsWith('.'+ext)) {
-			auto m = re.match(k);
-			if(m.hasMatch()) {
-				int idx = m.captured(1).toInt();
-				if(idx > maxIdx) maxIdx = idx;
+	insertPart(key, std::move(part));
+}
+
+int Package::nextImageIndex(const QString &ext) {
+	auto it = m_nextMediaIndex.find(ext);
+	if(it == m_nextMediaIndex.end()) {
+		// First image of this extension: scan existing media once, then count in memory
+		QRegularExpression re(QStringLiteral(R"(word/media/image(\d+)\.)") );
+		int maxIdx = 0;
+		for(const QString &k : partNames(PartKind::Media)) {
+			if(k.startsWith("word/media/image") && k.endsWith('.'+ext)) {
+				auto m = re.match(k);
+				if(m.hasMatch()) {
+					int idx = m.captured(1).toInt();
+					if(idx > maxIdx) maxIdx = idx;
+				}
 			}
 		}
+		it = m_nextMediaIndex.insert(ext, maxIdx + 1);
 	}
-	return maxIdx + 1;
+	return it.value()++;
 }
 
 void Package::ensureDefaultContentType(const QString &ext, const QString &mime) {
-	const QString ctName = QStringLiteral("[Content_Types].xml");
-	QByteArray xml;
-	if(auto existing = readPart(ctName)) {
-		xml = *existing;
-	} else {
-		xml = QByteArray("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-						 "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n"
-						 "  <Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n"
-						 "  <Default Extension=\"xml\"  ContentType=\"application/xml\"/>\n"
-						 "</Types>");
-	}
-	QString tag = QString("<Default Extension=\"%1\" ContentType=\"%2\"/>").arg(ext, mime);
-	if(!xml.contains(tag.toUtf8())) {
-		// naive insertion before closing </Types>
-		int pos = xml.lastIndexOf("</Types>");
-		if(pos >= 0) {
-			QByteArray insertion = QByteArray("  ") + tag.toUtf8() + '\n';
-			xml.insert(pos, insertion);
-		}
-		writePart(ctName, xml);
-	}
+	if(contentTypes().hasDefault(ext)) return;
+	mutableContentTypes().addDefault(ext, mime);
 }
 
 QString Package::addMedia(const QByteArray &bytes, const QString &extIn) {
 	QString ext = extIn.toLower();
 	if(ext.startsWith('.')) ext.remove(0,1);
+	if(mediaContentType(ext).isEmpty()) {
+		qWarning() << "Package: unsupported media type" << ext;
+		return {};
+	}
+	// Identical bytes with the same extension share one media part
+	QByteArray digest = QCryptographicHash::hash(bytes, QCryptographicHash::Sha1) + ext.toUtf8();
+	auto known = m_mediaByDigest.constFind(digest);
+	if(known != m_mediaByDigest.constEnd()) return known.value();
 	int idx = nextImageIndex(ext);
 	QString partName = QStringLiteral("word/media/image%1.%2").arg(idx).arg(ext);
 	writePart(partName, bytes);
-	// register content type (subset needed for parity)
-	if(ext == "png") ensureDefaultContentType(ext, "image/png");
-	else if(ext == "jpg" || ext == "jpeg") ensureDefaultContentType(ext, "image/jpeg");
-	else if(ext == "gif") ensureDefaultContentType(ext, "image/gif");
+	m_mediaByDigest.insert(digest, partName);
+	registerMediaContentType(ext);
+	return partName;
+}
+
+QString Package::addMediaFile(const QString &filePath, const QString &extIn) {
+	QFileInfo info(filePath);
+	const QString canonical = info.canonicalFilePath();
+	if(canonical.isEmpty() || !info.isReadable()) {
+		qWarning() << "Package: cannot read media file" << filePath;
+		return {};
+	}
+	QString ext = extIn.isEmpty() ? info.suffix().toLower() : extIn.toLower();
+	if(ext.startsWith('.')) ext.remove(0,1);
+	if(mediaContentType(ext).isEmpty()) {
+		qWarning() << "Package: unsupported media type" << ext << "for" << filePath;
+		return {};
+	}
+	auto known = m_mediaByFile.constFind(canonical);
+	if(known != m_mediaByFile.constEnd()) return known.value();
+	int idx = nextImageIndex(ext);
+	QString partName = QStringLiteral("word/media/image%1.%2").arg(idx).arg(ext);
+	Part part; part.sourceFile = canonical; part.size = (quint64)info.size();
+	insertPart(partName, std::move(part));
+	m_mediaByFile.insert(canonical, partName);
+	registerMediaContentType(ext);
 	return partName;
 }
 
+QString Package::mediaContentType(const QString &ext) {
+	// Image types Word accepts as picture parts; media with any other extension is not added
+	static const QHash<QString,QString> types{
+		{QStringLiteral("png"), QStringLiteral("image/png")},
+		{QStringLiteral("jpeg"), QStringLiteral("image/jpeg")},
+		{QStringLiteral("jpg"), QStringLiteral("image/jpeg")},
+		{QStringLiteral("gif"), QStringLiteral("image/gif")},
+		{QStringLiteral("bmp"), QStringLiteral("image/bmp")},
+		{QStringLiteral("tif"), QStringLiteral("image/tiff")},
+		{QStringLiteral("tiff"), QStringLiteral("image/tiff")},
+		{QStringLiteral("emf"), QStringLiteral("image/x-emf")},
+		{QStringLiteral("wmf"), QStringLiteral("image/x-wmf")},
+	};
+	return types.value(ext);
+}
+
+void Package::registerMediaContentType(const QString &ext) {
+	ensureDefaultContentType(ext, mediaContentType(ext));
+}
+
 }} // namespace QtDocxTemplate::opc
@@ -2,29 +2,117 @@
 #include <QString>
 #include <QByteArray>
 #include <QHash>
+#include <array>
+#include <memory>
 #include <optional>
 #include <QStringList>
+#include "QtDocxTemplate/CompressionPolicy.hpp"
+
+class QIODevice;
 
 namespace QtDocxTemplate { namespace opc {
 
+class Relationships;
+class ContentTypes;
+
 // Minimal OPC package handling using minizip/libzip
-// Simple in-memory representation of a DOCX OPC package (ZIP) providing
-// operations required for template processing. Focused implementation for DOCX files.
+// In-memory representation of a DOCX OPC package (ZIP) providing operations
+// required for template processing. Only the central directory is read at open;
+// part bytes are inflated on first access and cached. Focused implementation for DOCX files.
 class Package {
 public:
-    bool open(const QString &path);              // Load .docx (ZIP) into memory map
-    bool saveAs(const QString &path) const;       // Write current parts to .docx
-    std::optional<QByteArray> readPart(const QString &name) const; // Get part bytes if present
+    // Role of a part, derived from its name once when the part enters the index
+    enum class PartKind { MainDocument, Header, Footer, Relationships, Media, Numbering, ContentTypes, Other };
+    static constexpr int PartKindCount = 8;
+    static PartKind classify(const QString &name); // name already normalized
+
+    Package();
+    ~Package();
+    Package(const Package &) = delete; // use clone()
+    Package & operator=(const Package &) = delete;
+
+    bool open(const QString &path);              // Map .docx (ZIP) read-only and read its directory; parts inflated lazily
+    bool openData(const QByteArray &data);       // Same as open() for an in-memory .docx (buffer kept, not copied)
+    bool saveAs(const QString &path) const;       // Write current parts to .docx (untouched parts copied raw)
+    std::optional<QByteArray> saveToData() const; // Write current parts to an in-memory .docx
+    bool saveTo(QIODevice *device) const;         // Write current parts to device (opened WriteOnly if needed)
+    std::optional<QByteArray> readPart(const QString &name) const; // Get part bytes if present (inflates on first access)
     void writePart(const QString &name, const QByteArray &data);   // Create/overwrite a part
-    QString addMedia(const QByteArray &bytes, const QString &ext); // Adds media file and returns its part name
+    // Like readPart, but the package drops its own reference to the bytes when it can re-read them (untouched
+    // parts), so the caller usually holds the only copy and can parse it in place.
+    std::optional<QByteArray> releasePart(const QString &name);
+    // Adds media file (or finds identical one added before) and returns its part name; empty if ext has no
+    // known image content type (see mediaContentType)
+    QString addMedia(const QByteArray &bytes, const QString &ext);
+    // Adds media whose bytes stay on disk: the file is streamed into the ZIP entry on save and never held in
+    // memory (ext defaults to the file suffix). Returns the part name, or empty if the file is unreadable or
+    // ext has no known image content type.
+    QString addMediaFile(const QString &filePath, const QString &ext = QString());
+    // Media part added for an in-memory source identified by key (e.g. QImage::cacheKey() plus encoded size);
+    // empty if none. Lets callers skip encoding sources they already embedded.
+    QString mediaForSourceKey(const QByteArray &key) const { return m_mediaBySourceKey.value(key); }
+    void setMediaForSourceKey(const QByteArray &key, const QString &partName) { m_mediaBySourceKey.insert(key, partName); }
+    // Content type registered for media with this lower-case extension; empty if not supported
+    static QString mediaContentType(const QString &ext);
+    // Relationships of sourcePart (created if absent), kept parsed and written back once on save
+    Relationships & relationships(const QString &sourcePart);
+
+    // Independent package sharing this one's source archive and (copy-on-write) part buffers.
+    // Safe to call concurrently as long as nobody mutates this package meanwhile.
+    std::shared_ptr<Package> clone() const;
+    // Inflate all XML/rels parts now so that clones share them instead of inflating their own copies
+    void preloadXmlParts() const;
+    // Approximate bytes held: source archive plus inflated parts
+    qint64 memoryFootprint() const;
+
+    // Compression applied to rewritten parts on save (untouched parts keep their original bytes)
+    void setCompressionPolicy(const CompressionPolicy &policy) { m_compressionPolicy = policy; }
+    const CompressionPolicy & compressionPolicy() const { return m_compressionPolicy; }
 
-    bool hasPart(const QString &name) const { return m_parts.contains(name); }
+    bool hasPart(const QString &name) const { return findPart(name) != m_parts.end(); }
     QStringList partNames() const { return m_parts.keys(); }
+    // Normalized names of the parts of one kind, in order of first appearance (shared strings: lookups do not allocate)
+    const QStringList & partNames(PartKind kind) const { return m_partsByKind[static_cast<int>(kind)]; }
 
 private:
-    QHash<QString,QByteArray> m_parts; // partName -> data (always using forward slashes)
-    int nextImageIndex(const QString &ext) const; // scan existing media for next index
-    void ensureDefaultContentType(const QString &ext, const QString &mime); // update [Content_Types].xml
+    struct Archive; // backend handle of the source archive, kept open for lazy reads (shared by clones)
+    struct Part {
+        QByteArray data;          // inflated bytes, valid once loaded
+        qint64 sourceEntry{-1};   // libzip index / minizip central directory offset; -1 if created or rewritten in memory
+        quint64 size{0};          // uncompressed size recorded in the central directory
+        quint64 compressedSize{0};
+        quint32 crc{0};
+        int method{-1};           // ZIP compression method of the source entry (8 = deflate)
+        QString sourceFile;       // file streamed into the entry on save (addMediaFile); data stays empty
+        PartKind kind{PartKind::Other};
+        bool loaded{false};
+        // Never written since open: saveAs copies the original compressed bytes instead of recompressing
+        bool untouched() const { return sourceEntry >= 0; }
+    };
+    mutable QHash<QString,Part> m_parts; // partName -> part (always using forward slashes)
+    std::array<QStringList, PartKindCount> m_partsByKind; // names indexed by PartKind
+    std::shared_ptr<Archive> m_archive;
+    QHash<QString, std::shared_ptr<Relationships>> m_relationships; // rels part name -> parsed model
+    mutable std::shared_ptr<ContentTypes> m_contentTypes; // parsed on first use; shared with clones until modified
+    QHash<QString,int> m_nextMediaIndex; // extension -> next word/media/imageN index
+    QHash<QByteArray,QString> m_mediaByDigest; // SHA-1 + extension of media added since open -> part name
+    QHash<QByteArray,QString> m_mediaBySourceKey;
+    QHash<QString,QString> m_mediaByFile; // canonical file path -> part name
+    CompressionPolicy m_compressionPolicy{CompressionPolicy::defaults()};
+    QHash<QString,Part>::iterator findPart(const QString &name) const; // exact key first, normalized copy only if needed
+    void insertPart(const QString &key, Part part); // add or replace by normalized key, maintaining m_partsByKind
+    void clearParts();
+    bool openArchive(std::shared_ptr<Archive> archive); // open reader over archive->bytes
+    bool readDirectory(); // populate m_parts from the central directory of m_archive
+    bool readEntry(const Part &part, bool raw, QByteArray &out) const; // read source entry (raw = still compressed)
+    bool loadPart(Part &part) const; // inflate part bytes from the source archive
+    const ContentTypes & contentTypes() const;
+    ContentTypes & mutableContentTypes(); // detaches a model shared with clones
+    void flushModels() const; // write modified relationship/content-types models back into their parts
+    bool writeEntries(void *writer) const; // add all parts to an open backend writer (zip_t* / zipFile); false on the first failure
+    int nextImageIndex(const QString &ext); // allocate next media index (existing media scanned once per extension)
+    void ensureDefaultContentType(const QString &ext, const QString &mime); // add Default to the content-types model
+    void registerMediaContentType(const QString &ext); // Default entry for a supported media extension
     void normalizePath(QString &p) const; // ensure forward slashes, no leading ./
 };
 
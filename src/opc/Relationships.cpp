@@ -0,0 +1,56 @@
+#include "opc/Relationships.hpp"
+
+namespace QtDocxTemplate { namespace opc {
+
+const char *Relationships::ImageType = "http://schemas.openxmlformats.org/officeDocument/2006/relationships/image";
+
+QString Relationships::partNameFor(const QString &sourcePart) {
+	int slash = sourcePart.lastIndexOf('/');
+	return sourcePart.left(slash + 1) + QStringLiteral("_rels/") + sourcePart.mid(slash + 1) + QStringLiteral(".rels");
+}
+
+Relationships::Relationships(QString sourcePart)
+	: m_sourcePart(std::move(sourcePart)) {}
+
+void Relationships::load(const QByteArray &data) {
+	pugi::xml_document &doc = m_xml.doc();
+	if(data.isEmpty() || !m_xml.load(data)) doc.reset();
+	if(!doc.child("Relationships")) {
+		auto root = doc.append_child("Relationships");
+		root.append_attribute("xmlns") = "http://schemas.openxmlformats.org/package/2006/relationships";
+	}
+	int maxId = 0;
+	m_idByTypeTarget.clear();
+	for(auto r : doc.child("Relationships").children("Relationship")) {
+		QString id = r.attribute("Id").value();
+		m_idByTypeTarget.insert(QString::fromUtf8(r.attribute("Type").value()) + ' ' + QString::fromUtf8(r.attribute("Target").value()), id);
+		if(id.startsWith("rId")) {
+			bool ok=false; int num = id.mid(3).toInt(&ok); if(ok && num>maxId) maxId=num; }
+	}
+	m_nextId = maxId + 1;
+}
+
+QString Relationships::add(const char *type, const QString &targetPart) {
+	// Targets are relative to the source part's directory
+	int slash = m_sourcePart.lastIndexOf('/');
+	QString target = targetPart;
+	if(slash >= 0 && targetPart.startsWith(QStringView(m_sourcePart).left(slash + 1))) target = targetPart.mid(slash + 1);
+	else if(slash >= 0) target = '/' + targetPart;
+	QString key = QString::fromUtf8(type) + ' ' + target;
+	auto known = m_idByTypeTarget.constFind(key);
+	if(known != m_idByTypeTarget.constEnd()) return known.value();
+	QString rId = QStringLiteral("rId%1").arg(m_nextId++);
+	auto rel = m_xml.doc().child("Relationships").append_child("Relationship");
+	rel.append_attribute("Id") = rId.toUtf8().constData();
+	rel.append_attribute("Type") = type;
+	rel.append_attribute("Target") = target.toUtf8().constData();
+	m_idByTypeTarget.insert(key, rId);
+	m_modified = true;
+	return rId;
+}
+
+QByteArray Relationships::save() const {
+	return m_xml.save();
+}
+
+}} // namespace QtDocxTemplate::opc
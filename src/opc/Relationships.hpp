@@ -0,0 +1,34 @@
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include "xml/XmlPart.hpp"
+
+namespace QtDocxTemplate { namespace opc {
+
+// Parsed relationships part (<dir>/_rels/<name>.rels) of one source part. Kept in memory while
+// relationships are added and serialized once when the package is saved.
+class Relationships {
+public:
+    static const char *ImageType;
+    // Name of the relationships part belonging to sourcePart, e.g. word/_rels/document.xml.rels
+    static QString partNameFor(const QString &sourcePart);
+
+    explicit Relationships(QString sourcePart);
+    void load(const QByteArray &data); // existing part content; empty/invalid data starts an empty part
+    // Append a relationship and return its new Id (O(1): ids continue after the highest rIdN seen).
+    // If one with the same type and target exists, its Id is returned instead.
+    QString add(const char *type, const QString &targetPart);
+    QByteArray save() const;
+    bool modified() const { return m_modified; }
+    void setModified(bool modified) { m_modified = modified; }
+
+private:
+    QString m_sourcePart;
+    xml::XmlPart m_xml;
+    QHash<QString,QString> m_idByTypeTarget; // type + ' ' + target -> Id
+    int m_nextId{1};
+    bool m_modified{false};
+};
+
+}} // namespace QtDocxTemplate::opc
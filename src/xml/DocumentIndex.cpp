@@ -0,0 +1,52 @@
+#include "xml/DocumentIndex.hpp"
+#include <cstring>
+
+namespace QtDocxTemplate { namespace xml {
+
+void DocumentIndex::build(const pugi::xml_node &root) {
+	m_paragraphs.clear();
+	m_tables.clear();
+	m_texts.clear();
+	std::vector<size_t> open; // indices of paragraphs enclosing the current node
+	auto enter = [&](const pugi::xml_node &n) {
+		const char *name = n.name();
+		if(name[0] != 'w' || name[1] != ':') return;
+		if(std::strcmp(name + 2, "p") == 0) {
+			open.push_back(m_paragraphs.size());
+			m_paragraphs.push_back({n, static_cast<uint32_t>(m_texts.size()), 0, 0, static_cast<uint32_t>(m_tables.size()), 0});
+		} else if(std::strcmp(name + 2, "t") == 0) {
+			if(!open.empty()) m_texts.push_back(n);
+		} else if(std::strcmp(name + 2, "tbl") == 0) {
+			m_tables.push_back(n);
+		}
+	};
+	auto leave = [&](const pugi::xml_node &n) {
+		if(!open.empty() && m_paragraphs[open.back()].node == n) {
+			m_paragraphs[open.back()].endText = static_cast<uint32_t>(m_texts.size());
+			m_paragraphs[open.back()].endParagraph = static_cast<uint32_t>(m_paragraphs.size());
+			m_paragraphs[open.back()].endTable = static_cast<uint32_t>(m_tables.size());
+			open.pop_back();
+		}
+	};
+	// Iterative pre-order walk (no recursion depth limit for deeply nested tables)
+	for(pugi::xml_node n = root.first_child(); n; ) {
+		if(n.type() == pugi::node_element) {
+			enter(n);
+			if(pugi::xml_node child = n.first_child()) { n = child; continue; }
+		}
+		for(;;) {
+			leave(n);
+			if(pugi::xml_node sibling = n.next_sibling()) { n = sibling; break; }
+			n = n.parent();
+			if(!n || n == root) { n = pugi::xml_node(); break; }
+		}
+	}
+}
+
+QString DocumentIndex::paragraphText(const Paragraph &p) const {
+	QString text;
+	for(uint32_t i = p.firstText; i < p.endText; ++i) text += QString::fromUtf8(m_texts[i].text().get());
+	return text;
+}
+
+}} // namespace QtDocxTemplate::xml
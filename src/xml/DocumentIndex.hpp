@@ -0,0 +1,35 @@
+#pragma once
+#include <QString>
+#include <cstdint>
+#include <vector>
+#include <pugixml.hpp>
+
+namespace QtDocxTemplate { namespace xml {
+
+// Flat index of a WordprocessingML tree collected in one depth-first walk: every w:p and w:tbl in
+// document order plus the w:t nodes below each paragraph. Stands in for //w:p, //w:tbl and .//w:t
+// queries. Node handles are not updated when the tree changes; removed nodes must not be visited.
+class DocumentIndex {
+public:
+    struct Paragraph {
+        pugi::xml_node node;
+        uint32_t firstText{0}; // [firstText, endText) in texts(); nested paragraphs share their range
+        uint32_t endText{0};
+        uint32_t endParagraph{0}; // one past the last paragraph nested inside this one
+        uint32_t firstTable{0};   // [firstTable, endTable) in tables(): tables nested inside this paragraph
+        uint32_t endTable{0};
+    };
+
+    void build(const pugi::xml_node &root);
+    const std::vector<Paragraph> & paragraphs() const { return m_paragraphs; }
+    const std::vector<pugi::xml_node> & tables() const { return m_tables; }
+    const std::vector<pugi::xml_node> & texts() const { return m_texts; } // all w:t below paragraphs
+    QString paragraphText(const Paragraph &p) const; // concatenated w:t content (as .//w:t)
+
+private:
+    std::vector<Paragraph> m_paragraphs;
+    std::vector<pugi::xml_node> m_tables;
+    std::vector<pugi::xml_node> m_texts;
+};
+
+}} // namespace QtDocxTemplate::xml
@@ -5,10 +5,25 @@ namespace QtDocxTemplate { namespace xml {
 
 bool XmlPart::load(const QByteArray &data) {
 	m_doc.reset();
-	pugi::xml_parse_result res = m_doc.load_buffer(data.constData(), data.size(), pugi::parse_default | pugi::parse_ws_pcdata);
+	m_buffer.clear();
+	pugi::xml_parse_result res = m_doc.load_buffer(data.constData(), data.size(), ParseFlags, pugi::encoding_auto);
 	return res; // bool conversion indicates success
 }
 
+bool XmlPart::loadInPlace(QByteArray data) {
+	m_doc.reset();
+	m_buffer = std::move(data);
+	// pugixml rewrites the buffer while parsing and points into it afterwards; encoding detection only
+	// sniffs the BOM/declaration (UTF-16 parts, allowed by OPC, are converted into a buffer of its own)
+	pugi::xml_parse_result res = m_doc.load_buffer_inplace(m_buffer.data(), static_cast<size_t>(m_buffer.size()), ParseFlags, pugi::encoding_auto);
+	return res;
+}
+
+void XmlPart::copyFrom(const XmlPart &other) {
+	m_buffer.clear();
+	m_doc.reset(other.m_doc);
+}
+
 QByteArray XmlPart::save() const {
 	QByteArray out;
 	struct Writer : pugi::xml_writer {
@@ -9,12 +9,18 @@ namespace QtDocxTemplate { namespace xml {
 // XML document wrapper providing namespace handling and XPath queries
 class XmlPart {
 public:
-    bool load(const QByteArray &data); // parse; false on failure
+    // Default flags (attribute whitespace converted as before) plus whitespace-only text (w:t may hold just spaces)
+    static constexpr unsigned int ParseFlags = pugi::parse_default | pugi::parse_ws_pcdata;
+
+    bool load(const QByteArray &data); // parse a copy; false on failure
+    bool loadInPlace(QByteArray data); // parse inside data, kept alive by this part (no copy if data is not shared)
+    void copyFrom(const XmlPart &other); // deep copy of other's DOM (independent of its buffer)
     QByteArray save() const;           // serialize UTF-8 with XML decl
     std::vector<pugi::xml_node> selectAll(const char* xpath) const; // basic xpath queries
     pugi::xml_document & doc() { return m_doc; }
     const pugi::xml_document & doc() const { return m_doc; }
 private:
+    QByteArray m_buffer; // in-situ parse buffer referenced by m_doc
     pugi::xml_document m_doc;
 };
 